@@ -0,0 +1,55 @@
+import os
+import sys
+import argparse
+import subprocess
+import tempfile
+import time
+
+# Times the lexer on generated sources of several megabytes.  Almost
+# every identifier, integer and string in them is new, so entering them
+# in idtable, inttable and stringtable is a large part of the work.
+# Run it where the lexer is built: python3 lex_bench.py -l ./lexer
+
+parser = argparse.ArgumentParser(description = 'time the lexer on large generated sources')
+parser.add_argument('-l', '--lexer', default = './lexer')
+parser.add_argument('-m', '--megabytes', default = '1,4,16')
+parser.add_argument('-r', '--runs', default = 3, type = int)
+args = parser.parse_args()
+
+def generate(path, size):
+	with open(path, 'w') as out:
+		written = 0
+		i = 0
+		while written < size:
+			text = ('class C{0} inherits IO {{\n'
+				'  a{0} : Int <- {1};\n'
+				'  f{0}(x{0} : Int, y{0} : String) : String {{\n'
+				'    if x{0} < {2} then "s{0}".concat(y{0}) else "t{0}" fi\n'
+				'  }};\n'
+				'}};\n').format(i, i * 7919 % 1000003, i + 1)
+			out.write(text)
+			written += len(text)
+			i += 1
+
+# the best of the runs, in seconds
+def best_time(path):
+	best = None
+	for run in range(args.runs):
+		start = time.time()
+		status = subprocess.call([args.lexer, path], stdout = subprocess.DEVNULL)
+		elapsed = time.time() - start
+		if status != 0:
+			print('Fail, {0} exited with {1}'.format(args.lexer, status))
+			sys.exit(1)
+		if best is None or elapsed < best:
+			best = elapsed
+	return best
+
+work = tempfile.mkdtemp()
+print('{0:>6}  {1:>9}  {2:>9}'.format('MB', 'seconds', 'MB/s'))
+for mb in [int(m) for m in args.megabytes.split(',')]:
+	path = os.path.join(work, 'gen{0}.cl'.format(mb))
+	generate(path, mb << 20)
+	seconds = best_time(path)
+	print('{0:>6}  {1:>9.3f}  {2:>9.1f}'.format(mb, seconds, mb / seconds))
+	os.remove(path)
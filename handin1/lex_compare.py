@@ -0,0 +1,147 @@
+import os
+import sys
+import argparse
+import random
+import subprocess
+import tempfile
+import time
+
+# Lexes the same inputs with the flex scanner and with the hand scanner
+# that COOL_LEX_FAST selects, and checks that they print the same tokens.
+# The inputs are edge cases, random runs of tokens, whitespace, comments
+# and bad characters, and one large generated file, which also times the
+# two scanners.  Run it where the lexer is built: python3 lex_compare.py
+
+parser = argparse.ArgumentParser(description = 'compare the hand scanner with the flex scanner')
+parser.add_argument('-l', '--lexer', default = './lexer')
+parser.add_argument('-n', '--fragments', default = 2000, type = int)
+parser.add_argument('-m', '--megabytes', default = 4, type = int)
+parser.add_argument('-r', '--runs', default = 3, type = int)
+parser.add_argument('--seed', default = 0, type = int)
+args = parser.parse_args()
+
+edge_cases = [
+	'',
+	'"abc',
+	'"ab\ncd"',
+	'"ab\\',
+	'"ab\\\ncd"',
+	'"a\x00b"',
+	'"a\\\x00b"',
+	'"' + 'x' * 1024 + '"',
+	'"' + 'x' * 1025 + '"',
+	'"' + '\\n' * 1025 + '"',
+	'(* open',
+	'(* (* nested *) still open',
+	'(* (* nested *) *) x',
+	'*) x',
+	'-- tail',
+	'--',
+	'x\r\ny\rz',
+	'0000000000000000000000123 4294967296',
+	'tRuE FaLsE True False',
+	'classinherits Class_ if_',
+]
+
+atoms = ['class', 'Class', 'else', 'fi', 'if', 'in', 'inherits', 'let', 'loop', 'pool', 'then', 'while',
+	'case', 'esac', 'of', 'new', 'isvoid', 'not', 'true', 'tRUE', 'True', 'false', 'fALSE', 'False',
+	'x', '_x', '_X', 'Foo', 'foo_1', 'iff', 'classes', '123', '0', '007',
+	'=>', '<-', '<=', '<', '=', '>', '-', '--', '(*', '*)', '*', '(', ')', '[', ']', "'", '\\',
+	'"', '"abc"', '"a\\nb"', '"a\\\nb"', '"x\ny"', '"\\', '"\\0\\t\\b\\f\\q"',
+	'{', '}', ';', ':', ',', '.', '@', '~', '+', '/', '#', '$',
+	' ', '\t', '\n', '\n\n', '\r\n', '\f', '\v', '\x00', '\xe9', '\xff', '-- c\n', '(* c\n*) ', '(* (* *) ']
+
+def fragment(r):
+	text = ''.join(r.choice(atoms) + (' ' if r.random() < 0.3 else '') for i in range(r.randint(0, 60)))
+	if r.random() < 0.3:
+		text += r.choice(['"abc', '"ab\ncd', '(* open', '-- tail', '--', '"ab\\', '"'])
+	return text
+
+def generate(path, size):
+	with open(path, 'w') as out:
+		written = 0
+		i = 0
+		while written < size:
+			text = ('class C{0} inherits IO {{\n'
+				'  a{0} : Int <- {1};\n'
+				'  (* method {0} *)\n'
+				'  f{0}(x{0} : Int) : String {{\n'
+				'    if x{0} <= {2} then "s{0}\\t".concat("\\n") else "t{0}" fi -- {0}\n'
+				'  }};\n'
+				'}};\n').format(i, i * 7919 % 1000003, i + 1)
+			out.write(text)
+			written += len(text)
+			i += 1
+
+# the output of the lexer with one of the scanners, and the best time
+def lex(fast, files, runs = 1):
+	env = dict(os.environ)
+	env.pop('COOL_LEX_FAST', None)
+	if fast:
+		env['COOL_LEX_FAST'] = '1'
+	best = None
+	for run in range(runs):
+		start = time.time()
+		result = subprocess.run([args.lexer] + files, stdout = subprocess.PIPE, env = env)
+		elapsed = time.time() - start
+		if best is None or elapsed < best:
+			best = elapsed
+	return result.returncode, result.stdout, best
+
+# the output of each file, split at the lexer's #name lines
+def by_file(output):
+	files = []
+	for line in output.split(b'\n'):
+		if line.startswith(b'#name'):
+			files.append([])
+		if files:
+			files[-1].append(line)
+	return files
+
+def compare(files, flex_status, flex_output, hand_status, hand_output):
+	if flex_status != hand_status:
+		print('Wrong!!!!!!! flex exited with {0}, hand with {1}'.format(flex_status, hand_status))
+		return False
+	flex_files = by_file(flex_output)
+	hand_files = by_file(hand_output)
+	if len(flex_files) != len(files) or len(hand_files) != len(files):
+		print('Wrong!!!!!!! {0} files, flex printed {1}, hand printed {2}'.format(len(files), len(flex_files), len(hand_files)))
+		return False
+	same = True
+	for name, flex_lines, hand_lines in zip(files, flex_files, hand_files):
+		if flex_lines == hand_lines:
+			continue
+		same = False
+		for flex_line, hand_line in zip(flex_lines + [b''], hand_lines + [b'']):
+			if flex_line != hand_line:
+				print('Wrong!!!!!!! {0}'.format(name))
+				print('Flex output:{0} \n Hand output: {1} \n'.format(flex_line.decode('latin-1'), hand_line.decode('latin-1')))
+				break
+	return same
+
+work = tempfile.mkdtemp()
+r = random.Random(args.seed)
+sources = edge_cases + [fragment(r) for i in range(args.fragments)]
+files = []
+for i, text in enumerate(sources):
+	path = os.path.join(work, 'f{0}.cl'.format(i))
+	with open(path, 'wb') as out:
+		out.write(text.encode('latin-1'))
+	files.append(path)
+
+flex_status, flex_output, flex_time = lex(False, files)
+hand_status, hand_output, hand_time = lex(True, files)
+same = compare(files, flex_status, flex_output, hand_status, hand_output)
+
+large = os.path.join(work, 'large.cl')
+generate(large, args.megabytes << 20)
+flex_status, flex_output, flex_time = lex(False, [large], args.runs)
+hand_status, hand_output, hand_time = lex(True, [large], args.runs)
+same = compare([large], flex_status, flex_output, hand_status, hand_output) and same
+
+print('{0} MB: flex {1:.3f}s ({2:.1f} MB/s), hand {3:.3f}s ({4:.1f} MB/s)'.format(args.megabytes,
+	flex_time, args.megabytes / flex_time, hand_time, args.megabytes / hand_time))
+if not same:
+	print('(the inputs are in {0})'.format(work))
+	sys.exit(1)
+print('Success, {0} files lexed the same'.format(len(files) + 1))
@@ -4,7 +4,7 @@ import subprocess
 import argparse
 
 parser = argparse.ArgumentParser(description = 'input good or bad')
-parser.add_argument('-m','--mode',default = 'good', choices = ['good', 'bad', 'good2', 'bad2', 'good3'])
+parser.add_argument('-m','--mode',default = 'good', choices = ['good', 'bad', 'good2', 'bad2', 'good3', 'bad3'])
 args = parser.parse_args()
 
 file_name = args.mode + '.cl'
@@ -0,0 +1,33 @@
+(*
+ *  Errors the parser must recover from without crashing: each error
+ *  rule gives a value that the rules around it use afterwards.
+ *)
+
+(* error in a block, followed by more statements *)
+class Main {
+  main() : Object { { 1; 3 < 4 = true; 2; } };
+};
+
+(* errors in two blocks of one method, and statements on both sides *)
+class A {
+  f() : Object { { 1; 2 + ; 3; { 4; let ; 5; }; 6; } };
+};
+
+(* error in a feature, then a good feature *)
+class B {
+  x : Int <- ;
+  y : Int <- 1;
+  g() : Int { y };
+};
+
+(* error in a case branch, then a good branch *)
+class C {
+  h(o : Object) : Object { case o of a : Int => 1 + ; b : Object => 2; esac };
+};
+
+(* error in a class, then a good class *)
+class d inherits A { };
+
+class E inherits A {
+  k() : Object { { 7; 8 = = 9; } };
+};
@@ -8,22 +8,52 @@
   #include "cool-tree.h"
   #include "stringtab.h"
   #include "utilities.h"
+  #include <vector>
+  #include <thread>
+  #include <atomic>
+  #include <string.h>
+  #include <sstream>
   
   extern char *curr_filename;
+  extern int curr_lineno;
   
+  /* The parser is pure: everything one parse needs is in a ParseState,
+  passed to yyparse and on to yylex (see the end of this file). */
+  struct ParseState;
+  
+  /* One binding of a let chain, with the line its let node takes.  Both
+  parsers collect a whole chain before building it, so that a long
+  chain does not nest on their stacks. */
+  struct LetBinding {
+    int line;
+    Symbol name;
+    Symbol type;
+    Expression init;
+  };
+  typedef std::vector<LetBinding> LetBindings;
+  
+  Expression build_lets(const LetBindings &bindings, Expression body);
+  
+  
+  /* In C++ bison only grows its stacks for struct locations, which these
+  are not, so they start as deep as they may go: a few hundred KB of C
+  stack while parsing, for expressions nested thousands deep rather than
+  the hundred or so a YYINITDEPTH of 200 would take. */
+  #define YYMAXDEPTH 10000
+  #define YYINITDEPTH YYMAXDEPTH
   
   /* Locations */
-  #define YYLTYPE int              /* the type of locations */
-  #define cool_yylloc curr_lineno  /* use the curr_lineno from the lexer
-  for the location of tokens */
+  #define YYLTYPE int              /* the type of locations; yylex sets
+  each token's to the lexer's line */
     
     extern int node_lineno;          /* set before constructing a tree node
     to whatever you want the line number
     for the tree node to be */
       
       
+      /* an empty rule has no Rhs[1]: it takes the line of the symbol before it */
       #define YYLLOC_DEFAULT(Current, Rhs, N)         \
-      Current = Rhs[1];                             \
+      Current = (N) ? Rhs[1] : Rhs[0];              \
       node_lineno = Current;
     
     
@@ -74,8 +104,7 @@
     
     
     
-    void yyerror(char *s);        /*  defined below; called for each parse error */
-    extern int yylex();           /*  the entry point to the lexer  */
+    extern int yylex();           /*  the single-file entry point to the lexer  */
     
     /************************************************************************/
     /*                DONT CHANGE ANYTHING IN THIS SECTION                  */
@@ -85,6 +114,10 @@
     int omerrs = 0;               /* number of errors in lexing and parsing */
     %}
     
+    %define api.pure
+    %parse-param {ParseState *ps}
+    %lex-param {ParseState *ps}
+    
     /* A union of all the types that can be the result of parsing actions. */
     %union {
       Boolean boolean;
@@ -100,9 +133,41 @@
       Cases cases;
       Expression expression;
       Expressions expressions;
+      LetBinding let_binding;
+      LetBindings *let_bindings;
       char *error_msg;
     }
     
+    %{
+    /* A token with its value and line, as the lexer returned it. */
+    struct Token {
+      int token;
+      YYSTYPE lval;
+      int lineno;
+    };
+    
+    /* The state of one parse. */
+    struct ParseState {
+      char *filename;                /* the file being parsed */
+      std::vector<Token> *tokens;    /* tokens lexed ahead of time, or NULL
+      to read them from yylex() */
+      size_t next;                   /* the next of tokens to hand out */
+      int token;                     /* the last token read, for errors */
+      YYSTYPE lval;                  /* and its value */
+      int lineno;                    /* and its line */
+      Program ast_root;              /* the result of the parse */
+      Classes parse_results;
+      int omerrs;                    /* number of errors in this parse */
+      
+      ParseState(char *f, std::vector<Token> *t)
+      : filename(f), tokens(t), next(0), token(0), lineno(0),
+      ast_root(NULL), parse_results(NULL), omerrs(0) { }
+    };
+    
+    int yylex(YYSTYPE *lval, YYLTYPE *lloc, ParseState *ps);
+    void yyerror(YYLTYPE *lloc, ParseState *ps, char *s);
+    %}
+    
     /* 
     Declare the terminals; a few have types for associated lexemes.
     The token ERROR is never used in the parser; thus, it is a parse
@@ -145,11 +210,16 @@
     %type <expressions> expr_list
     %type <expressions> no_emp_expr_list
     %type <expressions> sentences
-    %type <expression> let_init_expr
+    %type <let_binding> let_binding
+    %type <let_bindings> let_bindings
     %type <case_> branch
     %type <cases> branch_list
     
     /* Precedence declarations go here. */
+    /* only to read "in let" as one more separator of a let chain: see
+    let_separator */
+    %nonassoc OBJECTID
+    %nonassoc LET
     %right ASSIGN
     %left NOT
     %nonassoc LE '<' '='
@@ -161,29 +231,31 @@
     %left '.'
     
     
+    %destructor { delete $$; } <let_bindings>
+    
     %%
     /* 
     Save the root of the abstract syntax tree in a global variable.
     */
-    program	: class_list	{ @$ = @1; ast_root = program($1); }
+    program	: class_list	{ @$ = @1; ps->ast_root = program($1); }
     ;
     
     class_list
     : class			/* single class */
     { $$ = single_Classes($1);
-    parse_results = $$; }
+    ps->parse_results = $$; }
     | class_list class	/* several classes */
     { $$ = append_Classes($1,single_Classes($2)); 
-    parse_results = $$; }
+    ps->parse_results = $$; }
     ;
     
     /* If no parent is specified, the class inherits from the Object class. */
     class	: CLASS TYPEID '{' dummy_feature_list '}' ';'
     { $$ = class_($2,idtable.add_string("Object"),$4,
-    stringtable.add_string(curr_filename)); }
+    stringtable.add_string(ps->filename)); }
     | CLASS TYPEID INHERITS TYPEID '{' dummy_feature_list '}' ';'
-    { $$ = class_($2,$4,$6,stringtable.add_string(curr_filename)); }
-    | error ';' { yyerrok; }
+    { $$ = class_($2,$4,$6,stringtable.add_string(ps->filename)); }
+    | error ';' { $$ = NULL; yyerrok; }
     ;
     
     /* Feature list may be empty, but no empty features in list. */
@@ -197,7 +269,7 @@
     { $$ = method($1, $3, $6, $8); }
     | OBJECTID ':' TYPEID init_expr ';'
     { $$ = attr($1, $3, $4); }
-    | error {}
+    | error { $$ = NULL; }
     ;
 
 
@@ -245,8 +317,8 @@
     | '{' sentences '}'
     { $$ = block($2); }
     /* let */
-    | LET let_init_expr
-    { $$ = $2; }
+    | let_bindings IN expr
+    { $$ = build_lets(*$1, $3); delete $1; }
     /* switch case */
     | CASE expr OF branch_list ESAC
     { $$ = typcase($2, $4); }
@@ -318,19 +390,33 @@
     { $$ = single_Expressions($1); }
     | sentences expr ';'
     { $$ = append_Expressions($1, single_Expressions($2)); }
-    | error ';' { yyerrok; }
+    /* the lists are appended to, so this one must be a real list */
+    | error ';' { $$ = nil_Expressions(); yyerrok; }
     ;
 
-    let_init_expr :
-    OBJECTID ':' TYPEID init_expr IN expr
-    { $$ = let($1, $3, $4, $6); }
-    | OBJECTID ':' TYPEID init_expr ',' let_init_expr
-    { $$ = let($1, $3, $4, $6); }
+    /* The bindings are collected left to right, so a chain takes the
+    same room on the stack however long it is. */
+    let_bindings :
+    LET let_binding
+    { $$ = new LetBindings(1, $2); }
+    | let_bindings let_separator let_binding
+    { $$ = $1; $$->push_back($3); }
+    ;
+    
+    let_binding : OBJECTID ':' TYPEID init_expr
+    { $$.line = @1; $$.name = $1; $$.type = $3; $$.init = $4; }
+    ;
+    
+    /* "let a : A in let b : B in e" is the same tree as "let a : A,
+    b : B in e".  After "in let" the parser could either go on with the
+    chain or start a new let in the body; reducing here (IN LET binds
+    tighter than the OBJECTID after it) goes on with the chain. */
+    let_separator : ',' | IN LET
     ;
 
     branch : OBJECTID ':' TYPEID DARROW expr ';'
     { $$ = branch($1, $3, $5); }
-    | error ';' { yyerrok; }
+    | error ';' { $$ = NULL; yyerrok; }
     ;
 
     branch_list :
@@ -343,18 +429,726 @@
     /* end of grammar */
     %%
     
+    /* yylval and yylloc are locals of the pure parser, so the cool_yylval
+    and curr_lineno the lexer sets (yylloc used to be #defined to
+    curr_lineno) are defined here. */
+    YYSTYPE cool_yylval;
+    int curr_lineno;
+    
     /* This function is called automatically when Bison detects a parse error. */
-    void yyerror(char *s)
+    void yyerror(YYLTYPE *lloc, ParseState *ps, char *s)
     {
-      extern int curr_lineno;
-      
-      cerr << "\"" << curr_filename << "\", line " << curr_lineno << ": " \
+      cerr << "\"" << ps->filename << "\", line " << ps->lineno << ": " \
       << s << " at or near ";
-      print_cool_token(yychar);
+      cool_yylval = ps->lval;       /* print_cool_token prints cool_yylval */
+      print_cool_token(ps->token);
       cerr << endl;
-      omerrs++;
+      ps->omerrs++;
       
-      if(omerrs>50) {fprintf(stdout, "More than 50 errors\n"); exit(1);}
+      if(omerrs+ps->omerrs>50) {fprintf(stdout, "More than 50 errors\n"); exit(1);}
+    }
+    
+    /* The pure parser's lexer: hand out the tokens lexed ahead of time if
+    there are any, otherwise call the single-file lexer. */
+    int yylex(YYSTYPE *lval, YYLTYPE *lloc, ParseState *ps)
+    {
+      int token = 0;
+      if (ps->tokens != NULL) {
+        if (ps->next < ps->tokens->size()) {
+          const Token &t = (*ps->tokens)[ps->next++];
+          token = t.token;
+          *lval = t.lval;
+          *lloc = t.lineno;
+        }
+      } else {
+        token = yylex();
+        *lval = cool_yylval;
+        *lloc = curr_lineno;
+      }
+      ps->token = token;
+      ps->lval = *lval;
+      ps->lineno = *lloc;
+      return token;
+    }
+    
+    /* The lets of a chain, built from the inside out around body. */
+    Expression build_lets(const LetBindings &bindings, Expression body)
+    {
+      for (size_t i = bindings.size(); i-- > 0; ) {
+        SET_NODELOC(bindings[i].line);
+        body = let(bindings[i].name, bindings[i].type, bindings[i].init, body);
+      }
+      return body;
+    }
+    
+    /* The single-file entry point the other phases use: parse what yylex()
+    returns, leaving the result in ast_root and parse_results. */
+    int yyparse()
+    {
+      ParseState ps(curr_filename, NULL);
+      int result = yyparse(&ps);
+      ast_root = ps.ast_root;
+      parse_results = ps.parse_results;
+      omerrs += ps.omerrs;
+      return result;
     }
     
-    
\ No newline at end of file
+    /*
+    A hand-written parser
+    
+    Setting COOL_PARSE_FAST in the environment parses the token buffers
+    by recursive descent instead of with the bison tables: one pass over
+    the tokens, no value or state stack, and expressions by precedence
+    climbing over the levels declared above.  It builds the same tree as
+    the grammar, node for node and line for line: a node takes the line
+    of the first token of the rule that builds it (YYLLOC_DEFAULT), an
+    empty list or no_expr that of the token before it, and every list
+    that of its first element.  It has no error recovery; at the first
+    syntax error it gives up and the file is parsed again with yyparse,
+    which reports the errors.  It gives up the same way on expressions
+    nested more than MAX_DEPTH deep, before the recursion runs out of
+    stack; let chains are read in a loop and do not count.
+    
+    COOL_PARSE_FAST=check parses every file both ways, keeps what bison
+    built, and reports the files whose trees differ.
+    */
+    class FastParser {
+    public:
+      FastParser(ParseState *p) : ps(p), toks(&(*p->tokens)[0]), pos(0), failed(false), depth(0) { }
+      
+      /* Parse the file, leaving the results in ps as yyparse would; false
+      at a syntax error. */
+      bool parse()
+      {
+        int l = line();
+        Classes classes = NULL;
+        do {
+          Class_ c = parse_class();
+          if (failed)
+            return false;
+          SET_NODELOC(l);
+          if (classes == NULL)
+            classes = single_Classes(c);
+          else
+            classes = append_Classes(classes, single_Classes(c));
+          ps->parse_results = classes;
+        } while (peek() != 0);
+        SET_NODELOC(l);
+        ps->ast_root = program(classes);
+        return true;
+      }
+      
+    private:
+      ParseState *ps;
+      const Token *toks;        /* ends with the 0 token */
+      size_t pos;
+      bool failed;
+      int depth;                /* of parse_unary calls, which every
+                                   nested expression goes through */
+      
+      /* About as deep as bison's stack (YYMAXDEPTH) lets most expressions
+      nest, and well within an 8 MB C stack for the phases after. */
+      enum { MAX_DEPTH = 5000 };
+      
+      /* One level of nesting, for as long as it is in scope; past
+      MAX_DEPTH the parse fails. */
+      struct Nesting {
+        FastParser *parser;
+        Nesting(FastParser *p) : parser(p)
+        {
+          if (++parser->depth > MAX_DEPTH)
+            parser->failed = true;
+        }
+        ~Nesting() { parser->depth--; }
+      };
+      
+      /* the precedence levels of the operators, as declared above */
+      enum { ASSIGN_PREC = 1, NOT_PREC, CMP_PREC, ADD_PREC, MUL_PREC };
+      
+      static int binary_prec(int token)
+      {
+        switch (token) {
+        case LE: case '<': case '=': return CMP_PREC;
+        case '+': case '-': return ADD_PREC;
+        case '*': case '/': return MUL_PREC;
+        }
+        return 0;
+      }
+      
+      int peek() const { return toks[pos].token; }
+      int peek2() const { return toks[pos].token == 0 ? 0 : toks[pos + 1].token; }
+      int line() const { return toks[pos].lineno; }
+      /* the line of an empty rule: that of the token before it */
+      int prev_line() const { return toks[pos - 1].lineno; }
+      
+      bool accept(int token)
+      {
+        if (failed || peek() != token)
+          return false;
+        pos++;
+        return true;
+      }
+      
+      void expect(int token)
+      {
+        if (!accept(token))
+          failed = true;
+      }
+      
+      Symbol expect_symbol(int token)
+      {
+        Symbol s = toks[pos].lval.symbol;
+        expect(token);
+        return s;
+      }
+      
+      Class_ parse_class()
+      {
+        int l = line();
+        expect(CLASS);
+        Symbol name = expect_symbol(TYPEID);
+        Symbol parent = NULL;
+        if (accept(INHERITS))
+          parent = expect_symbol(TYPEID);
+        expect('{');
+        if (failed)
+          return NULL;
+        SET_NODELOC(prev_line());
+        Features features = nil_Features();
+        int features_line = prev_line();
+        while (!failed && peek() != '}') {
+          Feature f = parse_feature();
+          if (failed)
+            return NULL;
+          SET_NODELOC(features_line);
+          features = append_Features(features, single_Features(f));
+        }
+        expect('}');
+        expect(';');
+        if (failed)
+          return NULL;
+        SET_NODELOC(l);
+        if (parent == NULL)
+          parent = idtable.add_string("Object");
+        return class_(name, parent, features, stringtable.add_string(ps->filename));
+      }
+      
+      Feature parse_feature()
+      {
+        int l = line();
+        Symbol name = expect_symbol(OBJECTID);
+        if (accept('(')) {
+          Formals formals = parse_formals();
+          expect(')');
+          expect(':');
+          Symbol type = expect_symbol(TYPEID);
+          expect('{');
+          Expression body = parse_expr(0);
+          expect('}');
+          expect(';');
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          return method(name, formals, type, body);
+        }
+        expect(':');
+        Symbol type = expect_symbol(TYPEID);
+        Expression init = parse_init();
+        expect(';');
+        if (failed)
+          return NULL;
+        SET_NODELOC(l);
+        return attr(name, type, init);
+      }
+      
+      /* an optional ASSIGN expr after a TYPEID */
+      Expression parse_init()
+      {
+        if (failed)
+          return NULL;
+        if (accept(ASSIGN))
+          return parse_expr(0);
+        SET_NODELOC(prev_line());
+        return no_expr();
+      }
+      
+      /* after '(' */
+      Formals parse_formals()
+      {
+        if (failed)
+          return NULL;
+        if (peek() == ')') {
+          SET_NODELOC(prev_line());
+          return nil_Formals();
+        }
+        int l = line();
+        Formals formals = NULL;
+        do {
+          int formal_line = line();
+          Symbol name = expect_symbol(OBJECTID);
+          expect(':');
+          Symbol type = expect_symbol(TYPEID);
+          if (failed)
+            return NULL;
+          SET_NODELOC(formal_line);
+          Formal f = formal(name, type);
+          SET_NODELOC(l);
+          if (formals == NULL)
+            formals = single_Formals(f);
+          else
+            formals = append_Formals(formals, single_Formals(f));
+        } while (accept(','));
+        return formals;
+      }
+      
+      /* after '(' */
+      Expressions parse_actuals()
+      {
+        if (failed)
+          return NULL;
+        if (peek() == ')') {
+          SET_NODELOC(prev_line());
+          return nil_Expressions();
+        }
+        int l = line();
+        Expressions actuals = NULL;
+        do {
+          Expression e = parse_expr(0);
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          if (actuals == NULL)
+            actuals = single_Expressions(e);
+          else
+            actuals = append_Expressions(actuals, single_Expressions(e));
+        } while (accept(','));
+        return actuals;
+      }
+      
+      /* An expression whose binary operators are at level min or above.
+      The comparisons do not associate, so a second one at the same level
+      is an error. */
+      Expression parse_expr(int min)
+      {
+        int l = line();
+        Expression left = parse_unary();
+        bool compared = false;
+        while (!failed) {
+          int op = peek();
+          int prec = binary_prec(op);
+          if (prec == 0 || prec < min)
+            break;
+          if (prec == CMP_PREC) {
+            if (compared) {
+              failed = true;
+              break;
+            }
+            compared = true;
+          }
+          pos++;
+          Expression right = parse_expr(prec + 1);
+          if (failed)
+            break;
+          SET_NODELOC(l);
+          switch (op) {
+          case '+': left = plus(left, right); break;
+          case '-': left = sub(left, right); break;
+          case '*': left = mul(left, right); break;
+          case '/': left = divide(left, right); break;
+          case '<': left = lt(left, right); break;
+          case LE: left = leq(left, right); break;
+          case '=': left = eq(left, right); break;
+          }
+        }
+        return failed ? NULL : left;
+      }
+      
+      /* The prefix operators bind tighter than anything to their left but
+      take as operand everything above their own level: NOT a < b is
+      NOT (a < b).  Assignments and lets run to the end of the
+      expression. */
+      Expression parse_unary()
+      {
+        Nesting nesting(this);
+        if (failed)
+          return NULL;
+        int l = line();
+        Expression e;
+        switch (peek()) {
+        case NOT:
+          pos++;
+          e = parse_expr(NOT_PREC + 1);
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          return comp(e);
+        case '~':
+          pos++;
+          e = parse_unary();
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          return neg(e);
+        case ISVOID:
+          pos++;
+          e = parse_unary();
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          return isvoid(e);
+        case LET:
+          pos++;
+          return parse_let();
+        case OBJECTID:
+          if (peek2() == ASSIGN) {
+            Symbol name = toks[pos].lval.symbol;
+            pos += 2;
+            e = parse_expr(ASSIGN_PREC);
+            if (failed)
+              return NULL;
+            SET_NODELOC(l);
+            return assign(name, e);
+          }
+          break;
+        }
+        return parse_postfix();
+      }
+      
+      /* After LET: the bindings and the body.  The bindings after a ','
+      and a body that is itself a let are read in the same loop, as
+      let_bindings does, so a long chain does not nest. */
+      Expression parse_let()
+      {
+        LetBindings bindings;
+        Expression body = NULL;
+        while (!failed) {
+          LetBinding b;
+          b.line = line();
+          b.name = expect_symbol(OBJECTID);
+          expect(':');
+          b.type = expect_symbol(TYPEID);
+          b.init = parse_init();
+          bindings.push_back(b);
+          if (accept(','))
+            continue;
+          expect(IN);
+          if (accept(LET))
+            continue;
+          body = failed ? NULL : parse_expr(0);
+          break;
+        }
+        if (failed)
+          return NULL;
+        return build_lets(bindings, body);
+      }
+      
+      /* a primary expression and the dispatches on it */
+      Expression parse_postfix()
+      {
+        int l = line();
+        Expression e = parse_primary();
+        while (!failed && (peek() == '.' || peek() == '@')) {
+          Symbol type = NULL;
+          if (accept('@'))
+            type = expect_symbol(TYPEID);
+          expect('.');
+          Symbol name = expect_symbol(OBJECTID);
+          expect('(');
+          Expressions actuals = parse_actuals();
+          expect(')');
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          if (type != NULL)
+            e = static_dispatch(e, type, name, actuals);
+          else
+            e = dispatch(e, name, actuals);
+        }
+        return failed ? NULL : e;
+      }
+      
+      Expression parse_primary()
+      {
+        int l = line();
+        const Token &t = toks[pos];
+        Expression e1, e2, e3;
+        switch (t.token) {
+        case OBJECTID:
+          pos++;
+          if (accept('(')) {
+            Expressions actuals = parse_actuals();
+            expect(')');
+            if (failed)
+              return NULL;
+            SET_NODELOC(l);
+            return dispatch(object(idtable.add_string("self")), t.lval.symbol, actuals);
+          }
+          SET_NODELOC(l);
+          return object(t.lval.symbol);
+        case INT_CONST:
+          pos++;
+          SET_NODELOC(l);
+          return int_const(t.lval.symbol);
+        case STR_CONST:
+          pos++;
+          SET_NODELOC(l);
+          return string_const(t.lval.symbol);
+        case BOOL_CONST:
+          pos++;
+          SET_NODELOC(l);
+          return bool_const(t.lval.boolean);
+        case NEW:
+          pos++;
+          {
+            Symbol type = expect_symbol(TYPEID);
+            if (failed)
+              return NULL;
+            SET_NODELOC(l);
+            return new_(type);
+          }
+        case '(':
+          pos++;
+          e1 = parse_expr(0);
+          expect(')');
+          return failed ? NULL : e1;
+        case IF:
+          pos++;
+          e1 = parse_expr(0);
+          expect(THEN);
+          e2 = failed ? NULL : parse_expr(0);
+          expect(ELSE);
+          e3 = failed ? NULL : parse_expr(0);
+          expect(FI);
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          return cond(e1, e2, e3);
+        case WHILE:
+          pos++;
+          e1 = parse_expr(0);
+          expect(LOOP);
+          e2 = failed ? NULL : parse_expr(0);
+          expect(POOL);
+          if (failed)
+            return NULL;
+          SET_NODELOC(l);
+          return loop(e1, e2);
+        case '{':
+          pos++;
+          {
+            int body_line = line();
+            Expressions body = NULL;
+            do {
+              e1 = parse_expr(0);
+              expect(';');
+              if (failed)
+                return NULL;
+              SET_NODELOC(body_line);
+              if (body == NULL)
+                body = single_Expressions(e1);
+              else
+                body = append_Expressions(body, single_Expressions(e1));
+            } while (peek() != '}');
+            pos++;
+            SET_NODELOC(l);
+            return block(body);
+          }
+        case CASE:
+          pos++;
+          e1 = parse_expr(0);
+          expect(OF);
+          {
+            int cases_line = line();
+            Cases cases = NULL;
+            do {
+              int branch_line = line();
+              Symbol name = expect_symbol(OBJECTID);
+              expect(':');
+              Symbol type = expect_symbol(TYPEID);
+              expect(DARROW);
+              e2 = failed ? NULL : parse_expr(0);
+              expect(';');
+              if (failed)
+                return NULL;
+              SET_NODELOC(branch_line);
+              Case c = branch(name, type, e2);
+              SET_NODELOC(cases_line);
+              if (cases == NULL)
+                cases = single_Cases(c);
+              else
+                cases = append_Cases(cases, single_Cases(c));
+            } while (peek() != ESAC);
+            pos++;
+            SET_NODELOC(l);
+            return typcase(e1, cases);
+          }
+        }
+        failed = true;
+        return NULL;
+      }
+    };
+    
+    /* How cool_parse_files parses: 0 with bison, 1 with the hand-written
+    parser, 2 both ways, comparing the trees. */
+    static int parse_mode()
+    {
+      const char *mode = getenv("COOL_PARSE_FAST");
+      if (mode == NULL)
+        return 0;
+      return strcmp(mode, "check") == 0 ? 2 : 1;
+    }
+    
+    static std::string dump_tree(Program p)
+    {
+      std::ostringstream os;
+      if (p != NULL)
+        p->dump_with_types(os, 0);
+      return os.str();
+    }
+    
+    /* Parse the tokens of ps in the way parse_mode() says. */
+    static void parse_tokens(ParseState &ps)
+    {
+      static const int mode = parse_mode();
+      if (mode == 1 && FastParser(&ps).parse())
+        return;
+      if (mode == 2) {
+        ParseState fast(ps.filename, ps.tokens);
+        bool ok = FastParser(&fast).parse();
+        yyparse(&ps);
+        if (ok != (ps.omerrs == 0) || (ok && dump_tree(fast.ast_root) != dump_tree(ps.ast_root)))
+          cerr << "\"" << ps.filename << "\": the hand-written parser and bison "
+          << "build different trees" << endl;
+        return;
+      }
+      ps.next = 0;
+      ps.ast_root = NULL;
+      ps.parse_results = NULL;
+      yyparse(&ps);
+    }
+    
+    /*
+    Parsing several files at once
+    
+    cool_parse_files lexes the files on up to jobs threads, each with its
+    own reentrant scanner, then parses them in the order given and joins
+    their classes into one program.  The tree nodes take their line
+    numbers from the global node_lineno, so the parses themselves run one
+    after another on the calling thread; they work from the token buffers
+    and are cheap next to the lexing.  The threads fill the symbol tables
+    in no fixed order, so afterwards the new entries are renumbered in the
+    order lexing the files one by one would have added them: the
+    constants of the program are laid out the same on every run.  The
+    scanner is only linked into the single-process compiler, so it is
+    referenced weakly here.
+    */
+    extern void *cool_lex_open(FILE *in, bool shared) __attribute__((weak));
+    extern int cool_lex(void *scanner, YYSTYPE *lval, int *lineno) __attribute__((weak));
+    extern void cool_lex_symbols(void *scanner, std::vector<Symbol> *ids,
+      std::vector<Symbol> *ints, std::vector<Symbol> *strs) __attribute__((weak));
+    extern void cool_lex_close(void *scanner) __attribute__((weak));
+    
+    /* The symbols lexing one input entered, by table. */
+    struct InputSymbols {
+      std::vector<Symbol> ids, ints, strs;
+    };
+    
+    /* Lex one input into tokens. */
+    static void lex_input(FILE *in, std::vector<Token> &tokens, InputSymbols &symbols)
+    {
+      void *scanner = cool_lex_open(in, true);
+      Token t;
+      t.lineno = 1;
+      do {
+        t.token = cool_lex(scanner, &t.lval, &t.lineno);
+        /* the message may live in the scanner's buffer */
+        if (t.token == ERROR)
+          t.lval.error_msg = strdup(t.lval.error_msg);
+        tokens.push_back(t);
+      } while (t.token != 0);
+      cool_lex_symbols(scanner, &symbols.ids, &symbols.ints, &symbols.strs);
+      cool_lex_close(scanner);
+    }
+    
+    /* Lex the n inputs open_input(i) returns on up to jobs threads, then
+    parse them in order; names[i] is the file name the errors and the
+    classes of input i carry. */
+    template <class Open>
+    static Program parse_inputs(int n, char **names, Open open_input, int jobs)
+    {
+      std::vector<std::vector<Token> > tokens(n);
+      std::vector<InputSymbols> symbols(n);
+      std::vector<char> opened(n);
+      std::atomic<int> next_input(0);
+      std::vector<std::thread> workers;
+      
+      if (cool_lex_open == NULL) {
+        cerr << "cool_parse_files: no scanner linked in" << endl;
+        exit(1);
+      }
+      
+      if (jobs < 1)
+        jobs = 1;
+      if (jobs > n)
+        jobs = n;
+      int id_base = idtable.size();
+      int int_base = inttable.size();
+      int str_base = stringtable.size();
+      for (int j = 0; j < jobs; j++) {
+        workers.push_back(std::thread([&]() {
+          int i;
+          while ((i = next_input++) < n) {
+            FILE *in = open_input(i);
+            if (in == NULL)
+              continue;
+            lex_input(in, tokens[i], symbols[i]);
+            fclose(in);
+            opened[i] = 1;
+          }
+        }));
+      }
+      for (size_t j = 0; j < workers.size(); j++)
+        workers[j].join();
+      
+      InputSymbols in_order;
+      for (int i = 0; i < n; i++) {
+        in_order.ids.insert(in_order.ids.end(), symbols[i].ids.begin(), symbols[i].ids.end());
+        in_order.ints.insert(in_order.ints.end(), symbols[i].ints.begin(), symbols[i].ints.end());
+        in_order.strs.insert(in_order.strs.end(), symbols[i].strs.begin(), symbols[i].strs.end());
+      }
+      idtable.renumber(id_base, in_order.ids);
+      inttable.renumber(int_base, in_order.ints);
+      stringtable.renumber(str_base, in_order.strs);
+      
+      Classes classes = nil_Classes();
+      for (int i = 0; i < n; i++) {
+        if (!opened[i]) {
+          cerr << "Could not open input file " << names[i] << endl;
+          omerrs++;
+          continue;
+        }
+        ParseState ps(names[i], &tokens[i]);
+        curr_filename = names[i];
+        parse_tokens(ps);
+        omerrs += ps.omerrs;
+        if (ps.parse_results != NULL)
+          classes = append_Classes(classes, ps.parse_results);
+      }
+      parse_results = classes;
+      ast_root = program(classes);
+      return ast_root;
+    }
+    
+    Program cool_parse_files(int nfiles, char **files, int jobs)
+    {
+      return parse_inputs(nfiles, files,
+        [&](int i) { return fopen(files[i], "r"); }, jobs);
+    }
+    
+    /* The same for sources already in memory: texts[i] holds the lens[i]
+    characters of the file called names[i]. */
+    Program cool_parse_buffers(int n, char **names, char **texts, size_t *lens, int jobs)
+    {
+      return parse_inputs(n, names,
+        [&](int i) { return fmemopen(texts[i], lens[i], "r"); }, jobs);
+    }
@@ -7,15 +7,43 @@
 //////////////////////////////////////////////////////////
 
 
+#include <stdlib.h>
 #include "tree.h"
 #include "cool-tree.handcode.h"
 #include "cool-tree.h"
+#include "tree-arena.h"
+#include "tree-list.h"
+
+
+// node arenas (see tree-arena.h)
+NodeArena* NodeArena::current_arena = new NodeArena;
+
+NodeArena::~NodeArena()
+{
+   for (size_t i = 0; i < blocks.size(); i++)
+      free(blocks[i]);
+}
+
+void NodeArena::new_block(size_t size)
+{
+   size_t block = size > BLOCK ? size : BLOCK;
+   next = (char *) malloc(block);
+   left = block;
+   blocks.push_back(next);
+}
+
+NodeArena* NodeArena::install(NodeArena* arena)
+{
+   NodeArena* previous = current_arena;
+   current_arena = arena;
+   return previous;
+}
 
 
 // constructors' functions
 Program program_class::copy_Program()
 {
-   return new program_class(classes->copy_list());
+   return new (NodeArena::current()) program_class(classes->copy_list());
 }
 
 
@@ -28,7 +56,7 @@ void program_class::dump(ostream& stream, int n)
 
 Class_ class__class::copy_Class_()
 {
-   return new class__class(copy_Symbol(name), copy_Symbol(parent), features->copy_list(), copy_Symbol(filename));
+   return new (NodeArena::current()) class__class(copy_Symbol(name), copy_Symbol(parent), features->copy_list(), copy_Symbol(filename));
 }
 
 
@@ -44,7 +72,7 @@ void class__class::dump(ostream& stream, int n)
 
 Feature method_class::copy_Feature()
 {
-   return new method_class(copy_Symbol(name), formals->copy_list(), copy_Symbol(return_type), expr->copy_Expression());
+   return new (NodeArena::current()) method_class(copy_Symbol(name), formals->copy_list(), copy_Symbol(return_type), expr->copy_Expression());
 }
 
 
@@ -60,7 +88,7 @@ void method_class::dump(ostream& stream, int n)
 
 Feature attr_class::copy_Feature()
 {
-   return new attr_class(copy_Symbol(name), copy_Symbol(type_decl), init->copy_Expression());
+   return new (NodeArena::current()) attr_class(copy_Symbol(name), copy_Symbol(type_decl), init->copy_Expression());
 }
 
 
@@ -75,7 +103,7 @@ void attr_class::dump(ostream& stream, int n)
 
 Formal formal_class::copy_Formal()
 {
-   return new formal_class(copy_Symbol(name), copy_Symbol(type_decl));
+   return new (NodeArena::current()) formal_class(copy_Symbol(name), copy_Symbol(type_decl));
 }
 
 
@@ -89,7 +117,7 @@ void formal_class::dump(ostream& stream, int n)
 
 Case branch_class::copy_Case()
 {
-   return new branch_class(copy_Symbol(name), copy_Symbol(type_decl), expr->copy_Expression());
+   return new (NodeArena::current()) branch_class(copy_Symbol(name), copy_Symbol(type_decl), expr->copy_Expression());
 }
 
 
@@ -104,7 +132,7 @@ void branch_class::dump(ostream& stream, int n)
 
 Expression assign_class::copy_Expression()
 {
-   return new assign_class(copy_Symbol(name), expr->copy_Expression());
+   return new (NodeArena::current()) assign_class(copy_Symbol(name), expr->copy_Expression());
 }
 
 
@@ -118,7 +146,7 @@ void assign_class::dump(ostream& stream, int n)
 
 Expression static_dispatch_class::copy_Expression()
 {
-   return new static_dispatch_class(expr->copy_Expression(), copy_Symbol(type_name), copy_Symbol(name), actual->copy_list());
+   return new (NodeArena::current()) static_dispatch_class(expr->copy_Expression(), copy_Symbol(type_name), copy_Symbol(name), actual->copy_list());
 }
 
 
@@ -134,7 +162,7 @@ void static_dispatch_class::dump(ostream& stream, int n)
 
 Expression dispatch_class::copy_Expression()
 {
-   return new dispatch_class(expr->copy_Expression(), copy_Symbol(name), actual->copy_list());
+   return new (NodeArena::current()) dispatch_class(expr->copy_Expression(), copy_Symbol(name), actual->copy_list());
 }
 
 
@@ -149,7 +177,7 @@ void dispatch_class::dump(ostream& stream, int n)
 
 Expression cond_class::copy_Expression()
 {
-   return new cond_class(pred->copy_Expression(), then_exp->copy_Expression(), else_exp->copy_Expression());
+   return new (NodeArena::current()) cond_class(pred->copy_Expression(), then_exp->copy_Expression(), else_exp->copy_Expression());
 }
 
 
@@ -164,7 +192,7 @@ void cond_class::dump(ostream& stream, int n)
 
 Expression loop_class::copy_Expression()
 {
-   return new loop_class(pred->copy_Expression(), body->copy_Expression());
+   return new (NodeArena::current()) loop_class(pred->copy_Expression(), body->copy_Expression());
 }
 
 
@@ -178,7 +206,7 @@ void loop_class::dump(ostream& stream, int n)
 
 Expression typcase_class::copy_Expression()
 {
-   return new typcase_class(expr->copy_Expression(), cases->copy_list());
+   return new (NodeArena::current()) typcase_class(expr->copy_Expression(), cases->copy_list());
 }
 
 
@@ -192,7 +220,7 @@ void typcase_class::dump(ostream& stream, int n)
 
 Expression block_class::copy_Expression()
 {
-   return new block_class(body->copy_list());
+   return new (NodeArena::current()) block_class(body->copy_list());
 }
 
 
@@ -205,7 +233,7 @@ void block_class::dump(ostream& stream, int n)
 
 Expression let_class::copy_Expression()
 {
-   return new let_class(copy_Symbol(identifier), copy_Symbol(type_decl), init->copy_Expression(), body->copy_Expression());
+   return new (NodeArena::current()) let_class(copy_Symbol(identifier), copy_Symbol(type_decl), init->copy_Expression(), body->copy_Expression());
 }
 
 
@@ -221,7 +249,7 @@ void let_class::dump(ostream& stream, int n)
 
 Expression plus_class::copy_Expression()
 {
-   return new plus_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) plus_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -235,7 +263,7 @@ void plus_class::dump(ostream& stream, int n)
 
 Expression sub_class::copy_Expression()
 {
-   return new sub_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) sub_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -249,7 +277,7 @@ void sub_class::dump(ostream& stream, int n)
 
 Expression mul_class::copy_Expression()
 {
-   return new mul_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) mul_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -263,7 +291,7 @@ void mul_class::dump(ostream& stream, int n)
 
 Expression divide_class::copy_Expression()
 {
-   return new divide_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) divide_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -277,7 +305,7 @@ void divide_class::dump(ostream& stream, int n)
 
 Expression neg_class::copy_Expression()
 {
-   return new neg_class(e1->copy_Expression());
+   return new (NodeArena::current()) neg_class(e1->copy_Expression());
 }
 
 
@@ -290,7 +318,7 @@ void neg_class::dump(ostream& stream, int n)
 
 Expression lt_class::copy_Expression()
 {
-   return new lt_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) lt_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -304,7 +332,7 @@ void lt_class::dump(ostream& stream, int n)
 
 Expression eq_class::copy_Expression()
 {
-   return new eq_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) eq_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -318,7 +346,7 @@ void eq_class::dump(ostream& stream, int n)
 
 Expression leq_class::copy_Expression()
 {
-   return new leq_class(e1->copy_Expression(), e2->copy_Expression());
+   return new (NodeArena::current()) leq_class(e1->copy_Expression(), e2->copy_Expression());
 }
 
 
@@ -332,7 +360,7 @@ void leq_class::dump(ostream& stream, int n)
 
 Expression comp_class::copy_Expression()
 {
-   return new comp_class(e1->copy_Expression());
+   return new (NodeArena::current()) comp_class(e1->copy_Expression());
 }
 
 
@@ -345,7 +373,7 @@ void comp_class::dump(ostream& stream, int n)
 
 Expression int_const_class::copy_Expression()
 {
-   return new int_const_class(copy_Symbol(token));
+   return new (NodeArena::current()) int_const_class(copy_Symbol(token));
 }
 
 
@@ -358,7 +386,7 @@ void int_const_class::dump(ostream& stream, int n)
 
 Expression bool_const_class::copy_Expression()
 {
-   return new bool_const_class(copy_Boolean(val));
+   return new (NodeArena::current()) bool_const_class(copy_Boolean(val));
 }
 
 
@@ -371,7 +399,7 @@ void bool_const_class::dump(ostream& stream, int n)
 
 Expression string_const_class::copy_Expression()
 {
-   return new string_const_class(copy_Symbol(token));
+   return new (NodeArena::current()) string_const_class(copy_Symbol(token));
 }
 
 
@@ -384,7 +412,7 @@ void string_const_class::dump(ostream& stream, int n)
 
 Expression new__class::copy_Expression()
 {
-   return new new__class(copy_Symbol(type_name));
+   return new (NodeArena::current()) new__class(copy_Symbol(type_name));
 }
 
 
@@ -397,7 +425,7 @@ void new__class::dump(ostream& stream, int n)
 
 Expression isvoid_class::copy_Expression()
 {
-   return new isvoid_class(e1->copy_Expression());
+   return new (NodeArena::current()) isvoid_class(e1->copy_Expression());
 }
 
 
@@ -410,7 +438,7 @@ void isvoid_class::dump(ostream& stream, int n)
 
 Expression no_expr_class::copy_Expression()
 {
-   return new no_expr_class();
+   return new (NodeArena::current()) no_expr_class();
 }
 
 
@@ -422,7 +450,7 @@ void no_expr_class::dump(ostream& stream, int n)
 
 Expression object_class::copy_Expression()
 {
-   return new object_class(copy_Symbol(name));
+   return new (NodeArena::current()) object_class(copy_Symbol(name));
 }
 
 
@@ -436,226 +464,226 @@ void object_class::dump(ostream& stream, int n)
 // interfaces used by Bison
 Classes nil_Classes()
 {
-   return new nil_node<Class_>();
+   return array_node<Class_>::nil();
 }
 
 Classes single_Classes(Class_ e)
 {
-   return new single_list_node<Class_>(e);
+   return array_node<Class_>::single(e);
 }
 
 Classes append_Classes(Classes p1, Classes p2)
 {
-   return new append_node<Class_>(p1, p2);
+   return array_node<Class_>::append(p1, p2);
 }
 
 Features nil_Features()
 {
-   return new nil_node<Feature>();
+   return array_node<Feature>::nil();
 }
 
 Features single_Features(Feature e)
 {
-   return new single_list_node<Feature>(e);
+   return array_node<Feature>::single(e);
 }
 
 Features append_Features(Features p1, Features p2)
 {
-   return new append_node<Feature>(p1, p2);
+   return array_node<Feature>::append(p1, p2);
 }
 
 Formals nil_Formals()
 {
-   return new nil_node<Formal>();
+   return array_node<Formal>::nil();
 }
 
 Formals single_Formals(Formal e)
 {
-   return new single_list_node<Formal>(e);
+   return array_node<Formal>::single(e);
 }
 
 Formals append_Formals(Formals p1, Formals p2)
 {
-   return new append_node<Formal>(p1, p2);
+   return array_node<Formal>::append(p1, p2);
 }
 
 Expressions nil_Expressions()
 {
-   return new nil_node<Expression>();
+   return array_node<Expression>::nil();
 }
 
 Expressions single_Expressions(Expression e)
 {
-   return new single_list_node<Expression>(e);
+   return array_node<Expression>::single(e);
 }
 
 Expressions append_Expressions(Expressions p1, Expressions p2)
 {
-   return new append_node<Expression>(p1, p2);
+   return array_node<Expression>::append(p1, p2);
 }
 
 Cases nil_Cases()
 {
-   return new nil_node<Case>();
+   return array_node<Case>::nil();
 }
 
 Cases single_Cases(Case e)
 {
-   return new single_list_node<Case>(e);
+   return array_node<Case>::single(e);
 }
 
 Cases append_Cases(Cases p1, Cases p2)
 {
-   return new append_node<Case>(p1, p2);
+   return array_node<Case>::append(p1, p2);
 }
 
 Program program(Classes classes)
 {
-  return new program_class(classes);
+  return new (NodeArena::current()) program_class(classes);
 }
 
 Class_ class_(Symbol name, Symbol parent, Features features, Symbol filename)
 {
-  return new class__class(name, parent, features, filename);
+  return new (NodeArena::current()) class__class(name, parent, features, filename);
 }
 
 Feature method(Symbol name, Formals formals, Symbol return_type, Expression expr)
 {
-  return new method_class(name, formals, return_type, expr);
+  return new (NodeArena::current()) method_class(name, formals, return_type, expr);
 }
 
 Feature attr(Symbol name, Symbol type_decl, Expression init)
 {
-  return new attr_class(name, type_decl, init);
+  return new (NodeArena::current()) attr_class(name, type_decl, init);
 }
 
 Formal formal(Symbol name, Symbol type_decl)
 {
-  return new formal_class(name, type_decl);
+  return new (NodeArena::current()) formal_class(name, type_decl);
 }
 
 Case branch(Symbol name, Symbol type_decl, Expression expr)
 {
-  return new branch_class(name, type_decl, expr);
+  return new (NodeArena::current()) branch_class(name, type_decl, expr);
 }
 
 Expression assign(Symbol name, Expression expr)
 {
-  return new assign_class(name, expr);
+  return new (NodeArena::current()) assign_class(name, expr);
 }
 
 Expression static_dispatch(Expression expr, Symbol type_name, Symbol name, Expressions actual)
 {
-  return new static_dispatch_class(expr, type_name, name, actual);
+  return new (NodeArena::current()) static_dispatch_class(expr, type_name, name, actual);
 }
 
 Expression dispatch(Expression expr, Symbol name, Expressions actual)
 {
-  return new dispatch_class(expr, name, actual);
+  return new (NodeArena::current()) dispatch_class(expr, name, actual);
 }
 
 Expression cond(Expression pred, Expression then_exp, Expression else_exp)
 {
-  return new cond_class(pred, then_exp, else_exp);
+  return new (NodeArena::current()) cond_class(pred, then_exp, else_exp);
 }
 
 Expression loop(Expression pred, Expression body)
 {
-  return new loop_class(pred, body);
+  return new (NodeArena::current()) loop_class(pred, body);
 }
 
 Expression typcase(Expression expr, Cases cases)
 {
-  return new typcase_class(expr, cases);
+  return new (NodeArena::current()) typcase_class(expr, cases);
 }
 
 Expression block(Expressions body)
 {
-  return new block_class(body);
+  return new (NodeArena::current()) block_class(body);
 }
 
 Expression let(Symbol identifier, Symbol type_decl, Expression init, Expression body)
 {
-  return new let_class(identifier, type_decl, init, body);
+  return new (NodeArena::current()) let_class(identifier, type_decl, init, body);
 }
 
 Expression plus(Expression e1, Expression e2)
 {
-  return new plus_class(e1, e2);
+  return new (NodeArena::current()) plus_class(e1, e2);
 }
 
 Expression sub(Expression e1, Expression e2)
 {
-  return new sub_class(e1, e2);
+  return new (NodeArena::current()) sub_class(e1, e2);
 }
 
 Expression mul(Expression e1, Expression e2)
 {
-  return new mul_class(e1, e2);
+  return new (NodeArena::current()) mul_class(e1, e2);
 }
 
 Expression divide(Expression e1, Expression e2)
 {
-  return new divide_class(e1, e2);
+  return new (NodeArena::current()) divide_class(e1, e2);
 }
 
 Expression neg(Expression e1)
 {
-  return new neg_class(e1);
+  return new (NodeArena::current()) neg_class(e1);
 }
 
 Expression lt(Expression e1, Expression e2)
 {
-  return new lt_class(e1, e2);
+  return new (NodeArena::current()) lt_class(e1, e2);
 }
 
 Expression eq(Expression e1, Expression e2)
 {
-  return new eq_class(e1, e2);
+  return new (NodeArena::current()) eq_class(e1, e2);
 }
 
 Expression leq(Expression e1, Expression e2)
 {
-  return new leq_class(e1, e2);
+  return new (NodeArena::current()) leq_class(e1, e2);
 }
 
 Expression comp(Expression e1)
 {
-  return new comp_class(e1);
+  return new (NodeArena::current()) comp_class(e1);
 }
 
 Expression int_const(Symbol token)
 {
-  return new int_const_class(token);
+  return new (NodeArena::current()) int_const_class(token);
 }
 
 Expression bool_const(Boolean val)
 {
-  return new bool_const_class(val);
+  return new (NodeArena::current()) bool_const_class(val);
 }
 
 Expression string_const(Symbol token)
 {
-  return new string_const_class(token);
+  return new (NodeArena::current()) string_const_class(token);
 }
 
 Expression new_(Symbol type_name)
 {
-  return new new__class(type_name);
+  return new (NodeArena::current()) new__class(type_name);
 }
 
 Expression isvoid(Expression e1)
 {
-  return new isvoid_class(e1);
+  return new (NodeArena::current()) isvoid_class(e1);
 }
 
 Expression no_expr()
 {
-  return new no_expr_class();
+  return new (NodeArena::current()) no_expr_class();
 }
 
 Expression object(Symbol name)
 {
-  return new object_class(name);
+  return new (NodeArena::current()) object_class(name);
 }
 
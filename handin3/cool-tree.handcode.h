@@ -12,6 +12,8 @@
 #endif
 
 #include <iostream>
+#include <stdint.h>
+#include <vector>
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
@@ -39,6 +41,8 @@ class Expression_class;
 typedef Expression_class *Expression;
 class Case_class;
 typedef Case_class *Case;
+class let_class;
+class AstWriter;
 
 typedef list_node<Class_> Classes_class;
 typedef Classes_class *Classes;
@@ -53,12 +57,16 @@ typedef Cases_class *Cases;
 
 #define Program_EXTRAS                          \
 virtual void semant() = 0;			\
-virtual void dump_with_types(ostream&, int) = 0;  
+virtual int check_semantics() = 0;		\
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define program_EXTRAS                          \
 void semant();     				\
-void dump_with_types(ostream&, int);          
+int check_semantics();				\
+void dump_with_types(ostream&, int); \
+uint32_t write_binary(AstWriter&);
 
 #define Class__EXTRAS                   \
 virtual Symbol get_filename() = 0;      \
@@ -67,7 +75,8 @@ virtual void dump_with_types(ostream&,int) = 0; \
 virtual void check_type() = 0;          \
 virtual void is_defined() = 0;        \
 virtual Symbol get_parent() = 0;          \
-virtual Features get_features() = 0;          
+virtual Features get_features() = 0; \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define class__EXTRAS                                 \
@@ -77,7 +86,8 @@ Symbol get_name() { return name; } 					\
 Symbol get_parent() {return parent; } 					\
 Features get_features() { return features; }        \
 void check_type();                                  \
-void is_defined();          
+void is_defined(); \
+uint32_t write_binary(AstWriter&);
 
 
 #define Feature_EXTRAS                                        \
@@ -86,11 +96,13 @@ virtual Symbol get_name() = 0;                  \
 virtual Symbol get_type() = 0;                  \
 virtual void is_defined() = 0;                  \
 virtual Symbol check_type() = 0;                  \
-virtual Boolean is_attr() = 0;                  
+virtual Boolean is_attr() = 0;                  \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int);    \
+uint32_t write_binary(AstWriter&);
 
 #define method_EXTRAS                  \
 Symbol get_name() { return name; }                  \
@@ -119,27 +131,31 @@ Expression get_init() { return init; } \
 virtual void dump_with_types(ostream&,int) = 0;     \
 virtual Symbol get_name() = 0;                      \
 virtual Symbol get_type() = 0;                      \
-virtual Symbol check_type() = 0;
+virtual Symbol check_type() = 0; \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 #define formal_EXTRAS                           \
 void dump_with_types(ostream&,int);             \
 Symbol get_name() { return name; }              \
 Symbol get_type() { return type_decl; }              \
-Symbol check_type();
+Symbol check_type(); \
+uint32_t write_binary(AstWriter&);
 
 #define Case_EXTRAS                             \
 Symbol type;                                     \
 virtual Symbol get_type() {return type; }        \
 virtual void dump_with_types(ostream& ,int) = 0; \
 virtual Symbol get_name() = 0;                   \
-virtual Symbol check_type() = 0;
+virtual Symbol check_type() = 0;                 \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 #define branch_EXTRAS                                   \
 void dump_with_types(ostream& ,int);                    \
 Symbol get_name() { return name; }                       \
 Expression get_expr() { return expr; }                   \
 Symbol get_type_decl() { return type_decl; }            \
-Symbol check_type();
+Symbol check_type(); \
+uint32_t write_binary(AstWriter&);
 
 #define Expression_EXTRAS                    \
 Symbol type;                                 \
@@ -148,10 +164,18 @@ Expression set_type(Symbol s) { type = s; return this; } \
 virtual void dump_with_types(ostream&,int) = 0;  \
 void dump_type(ostream&, int);               \
 Expression_class() { type = (Symbol) NULL; } \
-virtual Symbol check_type() = 0; 
+virtual Symbol check_type() = 0;             \
+virtual let_class* as_let() { return NULL; } \
+/* the left operand of + - * / or the receiver of a dispatch, for \
+walking chains that nest to the left without recursion */ \
+virtual Expression chain_e1() { return NULL; } \
+virtual Symbol check_chained(Symbol type1) { return NULL; } \
+virtual uint32_t write_chained(AstWriter&, uint32_t e1) { return 0; } \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 #define Expression_SHARED_EXTRAS           \
-void dump_with_types(ostream&,int); 
+void dump_with_types(ostream&,int);        \
+uint32_t write_binary(AstWriter&);
 
 #define assign_EXTRAS \
 Symbol get_name() { return name; }                       \
@@ -160,6 +184,9 @@ Symbol check_type();
 
 #define static_dispatch_EXTRAS \
 Expression get_expr() { return expr; }                   \
+Expression chain_e1() { return expr; }                   \
+Symbol check_chained(Symbol type1);                      \
+uint32_t write_chained(AstWriter&, uint32_t e1);         \
 Symbol get_type_name() { return type_name; } 					\
 Symbol get_name() { return name; } 					\
 Expressions get_actual() { return actual; } 					\
@@ -167,6 +194,9 @@ Symbol check_type();
 
 #define dispatch_EXTRAS \
 Expression get_expr() { return expr; }                   \
+Expression chain_e1() { return expr; }                   \
+Symbol check_chained(Symbol type1);                      \
+uint32_t write_chained(AstWriter&, uint32_t e1);         \
 Symbol get_name() { return name; } 					\
 Expressions get_actual() { return actual; } 					\
 Symbol check_type();
@@ -191,6 +221,8 @@ Symbol get_identifier() { return identifier; } 					\
 Symbol get_type_decl() { return type_decl; } 					\
 Expression get_init() { return init; }                   \
 Expression get_body() { return body; }                   \
+let_class* as_let() { return this; }                     \
+void check_binding();                                    \
 Symbol check_type();
 
 #define typcase_EXTRAS \
@@ -209,21 +241,33 @@ Symbol check_type();
 #define plus_EXTRAS \
 Expression get_e1() { return e1; }                   \
 Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
 Symbol check_type();
 
 #define sub_EXTRAS \
 Expression get_e1() { return e1; }                   \
 Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
 Symbol check_type();
 
 #define mul_EXTRAS \
 Expression get_e1() { return e1; }                   \
 Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
 Symbol check_type();
 
 #define divide_EXTRAS \
 Expression get_e1() { return e1; }                   \
 Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
 Symbol check_type();
 
 #define neg_EXTRAS \
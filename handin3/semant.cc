@@ -3,28 +3,45 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include "semant.h"
 #include "utilities.h"
+#include "tree-binary.h"
 
 #include <algorithm>
 #include <stack>
+#include <atomic>
+#include <sstream>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
 
 extern int semant_debug;
 extern char *curr_filename;
 
 static ClassTable* class_table;
-static SymbolTable identifier_table;
-static SymbolTable method_table;
-static Class_ cur_class;
-static int semant_errors = 0;
+// Scope state is per thread so that classes can be checked concurrently
+// (see ClassTable::check_type_parallel); with one thread nothing changes.
+static thread_local SymbolTable identifier_table;
+static thread_local SymbolTable method_table;
+static thread_local Class_ cur_class;
+static std::atomic<int> semant_errors(0);
 
 ostream& error_stream = cerr;
+// when set, errors of the class being checked are buffered here
+static thread_local ostream* class_error_stream = NULL;
+static thread_local int class_error_count = 0;
+// when set, classes whose methods the current class looks up are recorded
+static thread_local std::vector<ClassNode*>* class_deps = NULL;
+// when set, semant_error(t) records where in the buffered text it put the
+// line number of t, and t
+static thread_local std::vector<std::pair<size_t, tree_node*> >* class_error_lines = NULL;
 
 ostream& semant_error();
 ostream& semant_error(tree_node *t);
 
 Boolean is_compatible(Symbol C, Symbol P);
-std::vector<Symbol> get_anc_types(Symbol type);
 Symbol get_LCA_class(Symbol type1, Symbol type2);
 
 //////////////////////////////////////////////////////////////////////
@@ -99,31 +116,68 @@ static void initialize_constants(void)
 }
 
 // ClassNode
-void ClassNode::is_defined(){
-	
+// Walk the subtree rooted here with an explicit stack, so that deep
+// inheritance chains do not use up the C++ stack. Each class gets its own
+// scope, entered before visit() and left after all its subclasses.
+void ClassNode::visit_subtree(void (*visit)(ClassNode*)){
+	std::vector<std::pair<ClassNode*, int> > stack;
 	identifier_table.enterscope();
 	method_table.enterscope();
-
-	class_->is_defined();
-	
-	for(int i = 0;i < num_childs;i++){
-		children[i]->is_defined();
+	visit(this);
+	stack.push_back(std::make_pair(this, 0));
+	while(!stack.empty()){
+		ClassNode* node = stack.back().first;
+		if(stack.back().second < node->num_childs){
+			ClassNode* child = node->children[stack.back().second++];
+			identifier_table.enterscope();
+			method_table.enterscope();
+			visit(child);
+			stack.push_back(std::make_pair(child, 0));
+		}
+		else{
+			method_table.exitscope();
+			identifier_table.exitscope();
+			stack.pop_back();
+		}
 	}
-	method_table.exitscope();
-	identifier_table.exitscope();
 }
 
-void ClassNode::check_type(){
+static void define_class(ClassNode* node){
+	node->get_class()->is_defined();
+}
+
+static void check_class(ClassNode* node){
+	cur_class = node->get_class();
+	cur_class->check_type();
+}
+
+void ClassNode::is_defined(){
+	visit_subtree(define_class);
+}
+
+// Like check_type() but without the ancestors' scopes on the stack: the
+// inherited names are seeded from the flattened tables instead.
+void ClassNode::check_type_isolated(){
+	method_table.enterscope();
+	identifier_table.enterscope();
+	if(parent_node != NULL){
+		for(FeatureTable::const_iterator iter = parent_node->methods.begin(); iter != parent_node->methods.end(); ++iter)
+			method_table.addid(iter->first, iter->second.feature->get_type());
+		for(FeatureTable::const_iterator iter = parent_node->attrs.begin(); iter != parent_node->attrs.end(); ++iter)
+			identifier_table.addid(iter->first, iter->second.feature->get_type());
+	}
 	method_table.enterscope();
 	identifier_table.enterscope();
 	cur_class = class_;
 	class_->check_type();
-	
-	for(int i = 0;i < num_childs;i++){
-		children[i]->check_type();
-	}
 	method_table.exitscope();
 	identifier_table.exitscope();
+	method_table.exitscope();
+	identifier_table.exitscope();
+}
+
+void ClassNode::check_type(){
+	visit_subtree(check_class);
 }
 
 
@@ -238,17 +292,28 @@ void ClassTable::install_basic_classes() {
 
 }
 
+// The inheritance graph is built in two passes: append() declares every
+// class in the name index, then link_classes() resolves each parent
+// through the index and mark_cycles() flags the classes on a cycle.
 ClassTable::ClassTable(Classes classes): main_node(NULL) {
 	install_basic_classes();
 	for(int i = classes->first(); classes->more(i);i = classes->next(i)){
 		append(classes->nth(i));
 	}
+	link_classes();
+	mark_cycles();
+}
+
+ClassTable::~ClassTable(){
+	for(size_t i = 0; i < declared_nodes.size(); i++)
+		delete declared_nodes[i];
 }
 
+ClassNode::~ClassNode(){ }
+
 
 void ClassTable::append(Class_ cls){
 	Symbol name = cls->get_name();
-	Symbol parent = cls->get_parent();
 	cur_class = cls;
 		
 	if(name == SELF_TYPE){
@@ -256,46 +321,64 @@ void ClassTable::append(Class_ cls){
 		return;
 	}
 
-	if(name == Object){
-		root_nodes.push_back(new ClassNode(cls));
-		return;
-	}
-
-	ClassNode* cur_node = NULL;
 	// 查看是否已经存在
-	cur_node = find_class(cls);
-
-	if(cur_node == NULL)
-		// 如若不存在 创建一个
-		cur_node = new ClassNode(cls);
-	else{
+	if(find_class(name) != NULL){
 		semant_error(cls) << name << "Has already been defined" << endl;
 		return;
 	}
 
+	ClassNode* cur_node = new ClassNode(cls);
+	class_index[name] = cur_node;
+	declared_nodes.push_back(cur_node);
+
 	if(name == Main)
 		main_node = cur_node;
-	
-	ClassNode* parent_node = find_class(parent);
-	ClassNode* child_node = NULL;
-
-	// 如果父节点存在 将该节点加入父节点的children
-	if (parent_node) parent_node->append_child(cur_node);
-	// 如果父节点不存在 该节点暂时就是一个root
-	else root_nodes.push_back(cur_node);
-
-
-	// 从root中，检索有哪些类是继承了当前的类的
-	std::vector<ClassNode*>::iterator iter;
-	for(iter = root_nodes.begin();iter != root_nodes.end(); iter++){
-		if((*iter)->get_parent() == cls->get_name()){
-			child_node = (*iter);
-			cur_node->append_child(child_node);
-			root_nodes.erase(iter--);
-			
-			if(find_class(cur_node) == NULL)
-				root_nodes.push_back(cur_node);
+}
+
+void ClassTable::link_classes(){
+	for(size_t i = 0; i < declared_nodes.size(); i++){
+		ClassNode* cur_node = declared_nodes[i];
+		Symbol parent = cur_node->get_parent();
+
+		ClassNode* parent_node = NULL;
+		// 不能继承基本类，这类错误在is_inherit_legal中报告
+		if(cur_node->get_name() != Object && parent != Int && parent != Str && parent != Bool)
+			parent_node = find_class(parent);
+
+		// 如果父节点存在 将该节点加入父节点的children，否则该节点是一个root
+		if(parent_node){
+			cur_node->parent_node = parent_node;
+			parent_node->append_child(cur_node);
 		}
+		else root_nodes.push_back(cur_node);
+	}
+}
+
+// Follow parent links from every class. A walk stops at a class already
+// finished or at a root; running into a class on the current walk means
+// the walk has closed a cycle, and every class from there on is on it.
+// Each class is walked over once, so this is linear in the class count.
+void ClassTable::mark_cycles(){
+	const int UNSEEN = 0, ON_PATH = 1, DONE = 2;
+	std::unordered_map<ClassNode*, int> state;
+	std::vector<ClassNode*> path;
+
+	for(size_t i = 0; i < declared_nodes.size(); i++){
+		ClassNode* node = declared_nodes[i];
+		path.clear();
+		while(node != NULL && state[node] == UNSEEN){
+			state[node] = ON_PATH;
+			path.push_back(node);
+			node = node->parent_node;
+		}
+		if(node != NULL && state[node] == ON_PATH){
+			for(size_t j = path.size(); j-- > 0; ){
+				path[j]->in_cycle = TRUE;
+				if(path[j] == node) break;
+			}
+		}
+		for(size_t j = 0; j < path.size(); j++)
+			state[path[j]] = DONE;
 	}
 }
 
@@ -305,7 +388,14 @@ void ClassTable::check_Main(){
 		return;
 	}
 	cur_class = main_node->get_class();
-	Method main = main_node->find_method(main_meth);
+	// the feature tables are not built yet, so look through Main's own features
+	Method main = NULL;
+	Features features = cur_class->get_features();
+	for(int i = features->first(); features->more(i) && main == NULL; i = features->next(i)){
+		Feature feature = features->nth(i);
+		if(!feature->is_attr() && feature->get_name() == main_meth)
+			main = (Method)feature;
+	}
 	if(main == NULL)
 		semant_error(cur_class) << "Class Main has no Method main()" << endl;
 	else if(main->get_formals()->len() != 0)
@@ -313,11 +403,11 @@ void ClassTable::check_Main(){
 }
 
 Boolean ClassTable::is_inherit_legal(){
-	for(size_t i = 0; i < root_nodes.size();i++){
-		ClassNode* root = root_nodes[i];
-		cur_class = root->get_class();
+	for(size_t i = 0; i < declared_nodes.size();i++){
+		ClassNode* node = declared_nodes[i];
+		cur_class = node->get_class();
 
-		if(root->get_name() == Object)
+		if(node->get_name() == Object)
 			continue;
 
 		Symbol parent = cur_class->get_parent();
@@ -328,18 +418,88 @@ Boolean ClassTable::is_inherit_legal(){
 		else if(find_class(parent) == NULL){
 			semant_error(cur_class) << "Class " << cur_class->get_name() << " inherits from undefined classes " << parent <<  endl;
 		}
-		else{
+		else if(node->in_cycle){
 			semant_error(cur_class) << "Class " << cur_class->get_name() << " involved in a cycle "<<endl;
 		}
 	}
 
 	if(semant_errors || root_nodes.size() != 1){
 		cerr << "Compilation halted due to static semantic errors." << endl;
-		exit(1);
+		return FALSE;
 	}
 	return TRUE;
 }
 
+// Assign preorder/postorder numbers, depths and the binary lifting table.
+// Must run after is_inherit_legal(), when the classes form a single tree.
+void ClassTable::number_classes(){
+	ClassNode* root = get_root();
+	std::vector<std::pair<ClassNode*, int> > stack;
+	int clock = 0;
+
+	preorder_nodes.clear();
+	preorder_nodes.push_back(root);
+	root->depth = 0;
+	root->ancestors.clear();
+	root->preorder = clock++;
+	stack.push_back(std::make_pair(root, 0));
+	while(!stack.empty()){
+		ClassNode* node = stack.back().first;
+		int next_child = stack.back().second;
+		if(next_child == node->num_childs){
+			node->postorder = clock++;
+			stack.pop_back();
+			continue;
+		}
+		stack.back().second++;
+
+		ClassNode* child = node->children[next_child];
+		child->depth = node->depth + 1;
+		child->ancestors.clear();
+		child->ancestors.push_back(node);
+		for(size_t k = 1; ((size_t)1 << k) <= (size_t)child->depth; k++)
+			child->ancestors.push_back(child->ancestors[k-1]->ancestors[k-1]);
+		child->preorder = clock++;
+		preorder_nodes.push_back(child);
+		stack.push_back(std::make_pair(child, 0));
+	}
+}
+
+// Give every class one method table and one attribute table holding its
+// own features and everything it inherits. Classes are visited parents
+// first, so each one starts from a copy of its parent's finished tables.
+void ClassTable::build_feature_tables(){
+	for(size_t i = 0; i < preorder_nodes.size(); i++){
+		ClassNode* node = preorder_nodes[i];
+		if(node->depth > 0){
+			node->methods = node->ancestors[0]->methods;
+			node->attrs = node->ancestors[0]->attrs;
+		}
+
+		Features features = node->class_->get_features();
+		for(int j = features->first(); features->more(j); j = features->next(j)){
+			Feature feature = features->nth(j);
+			FeatureTable& table = feature->is_attr() ? node->attrs : node->methods;
+			FeatureEntry& entry = table[feature->get_name()];
+			// a duplicate inside one class is reported by is_defined(); keep the first
+			if(entry.owner == node) continue;
+			entry.feature = feature;
+			entry.owner = node;
+		}
+	}
+}
+
+ClassNode* ClassTable::get_LCA(ClassNode* a, ClassNode* b){
+	if(b->is_subclass_of(a)) return a;
+	if(a->is_subclass_of(b)) return b;
+	// climb from a to the highest ancestor that is still not above b
+	for(int k = (int)a->ancestors.size() - 1; k >= 0; k--){
+		if(k < (int)a->ancestors.size() && !b->is_subclass_of(a->ancestors[k]))
+			a = a->ancestors[k];
+	}
+	return a->ancestors[0];
+}
+
 ClassNode* ClassTable::get_root(){
 	return root_nodes[0];
 }
@@ -355,32 +515,407 @@ void ClassTable::check_type(){
 	root_node->check_type();
 }
 
+// Check every class on its own, spread over `jobs` threads. A class only
+// reads the flattened tables of its ancestors, so classes are independent;
+// each one's errors are buffered and printed in declaration order so the
+// output does not depend on scheduling.
+void ClassTable::check_type_parallel(int jobs){
+	std::vector<std::string> errors;
+	std::vector<int> error_counts;
+	std::vector<std::vector<ClassNode*> > deps;
+	check_isolated(preorder_nodes, errors, error_counts, deps, NULL, jobs);
+
+	std::unordered_map<ClassNode*, size_t> slot;
+	for(size_t i = 0; i < preorder_nodes.size(); i++)
+		slot[preorder_nodes[i]] = i;
+	for(size_t i = 0; i < declared_nodes.size(); i++){
+		std::unordered_map<ClassNode*, size_t>::const_iterator iter = slot.find(declared_nodes[i]);
+		if(iter != slot.end())
+			error_stream << errors[iter->second];
+	}
+}
+
+// Check nodes[i] with check_type_isolated(), collecting for each class its
+// error text, its error count and the classes whose methods it looked up,
+// and, if error_lines is set, where the text has line numbers and of what.
+void ClassTable::check_isolated(const std::vector<ClassNode*>& nodes, std::vector<std::string>& errors,
+	std::vector<int>& error_counts, std::vector<std::vector<ClassNode*> >& deps,
+	std::vector<std::vector<std::pair<size_t, tree_node*> > >* error_lines, int jobs){
+	errors.assign(nodes.size(), std::string());
+	error_counts.assign(nodes.size(), 0);
+	deps.assign(nodes.size(), std::vector<ClassNode*>());
+	if(error_lines != NULL)
+		error_lines->assign(nodes.size(), std::vector<std::pair<size_t, tree_node*> >());
+	std::atomic<size_t> next(0);
+
+	auto worker = [&](){
+		for(size_t i = next++; i < nodes.size(); i = next++){
+			std::ostringstream buffer;
+			class_error_stream = &buffer;
+			class_error_count = 0;
+			class_deps = &deps[i];
+			class_error_lines = error_lines != NULL ? &(*error_lines)[i] : NULL;
+			nodes[i]->check_type_isolated();
+			errors[i] = buffer.str();
+			error_counts[i] = class_error_count;
+		}
+		class_error_stream = NULL;
+		class_deps = NULL;
+		class_error_lines = NULL;
+	};
+
+	if(jobs > (int)nodes.size())
+		jobs = nodes.size();
+	std::vector<std::thread> threads;
+	for(int i = 1; i < jobs; i++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+Method ClassTable::find_method(Symbol cls, Symbol meth){
+	ClassNode* class_node = find_class(cls);
+	if(class_node == NULL) return NULL;
+	if(class_deps != NULL)
+		class_deps->push_back(class_node);
+	return class_node->find_method(meth);
+}
+
+
+// Incremental checking
+//
+// The cache file keeps, for every class, a key made of the class's own
+// source (without line numbers), its flattened interface and the shape of
+// the inheritance graph, the interfaces of the classes it dispatched into,
+// and what checking produced: the type of every expression and the error
+// text. A class whose key and dependencies still match is not checked
+// again; its types are copied back into the fresh AST and its errors
+// replayed. The cached errors do not hold line numbers but the node each
+// one is about, so a class that only moved is replayed with its new lines.
+
+static unsigned long long hash_string(const std::string& s, unsigned long long h = 14695981039346656037ULL){
+	for(size_t i = 0; i < s.size(); i++){
+		h ^= (unsigned char)s[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static unsigned long long hash_combine(unsigned long long h, unsigned long long v){
+	return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+// hash of the class as written, line numbers left out: its binary tree
+// with its own symbols (see AstWriter); nodes receives every node of the
+// class and exprs every expression, in the order they are written
+unsigned long long ClassNode::body_hash(std::vector<tree_node*>& nodes, std::vector<Expression>& exprs){
+	AstWriter writer(false, false);
+	class_->write_binary(writer);
+	std::vector<AstRecord> records = writer.get_nodes();
+	nodes = writer.get_tree_nodes();
+	for(size_t i = 0; i < records.size(); i++){
+		records[i].line = 0;
+		if(records[i].kind >= AST_ASSIGN && records[i].kind <= AST_OBJECT)
+			exprs.push_back(static_cast<Expression>(nodes[i]));
+	}
+
+	const std::vector<char>& symbols = writer.get_symbol_text();
+	const std::vector<uint32_t>& children = writer.get_children();
+	std::string text(symbols.begin(), symbols.end());
+	text.append((const char*)records.data(), records.size() * sizeof(AstRecord));
+	text.append((const char*)children.data(), children.size() * sizeof(uint32_t));
+	return hash_string(text);
+}
+
+// hash of the names and types of the class's own features
+unsigned long long ClassNode::interface_hash(){
+	std::ostringstream text;
+	text << class_->get_name() << " " << class_->get_parent() << "\n";
+	Features features = class_->get_features();
+	for(int i = features->first(); features->more(i); i = features->next(i)){
+		Feature feature = features->nth(i);
+		text << (feature->is_attr() ? "attr " : "method ") << feature->get_name() << " " << feature->get_type();
+		if(!feature->is_attr()){
+			Formals formals = ((Method)feature)->get_formals();
+			for(int j = formals->first(); formals->more(j); j = formals->next(j))
+				text << " " << formals->nth(j)->get_type();
+		}
+		text << "\n";
+	}
+	return hash_string(text.str());
+}
+
+struct CachedClass{
+	unsigned long long key;
+	int error_count;
+	std::vector<std::pair<std::string, unsigned long long> > deps;
+	std::vector<std::string> types;
+	// the error text with the line numbers cut out, and for each one its
+	// offset in the text and the position of its node in the class
+	std::string errors;
+	std::vector<std::pair<size_t, size_t> > error_lines;
+};
+
+static const char* CACHE_MAGIC = "cool-semant-cache 3";
+
+static void read_cache(const char* path, std::unordered_map<std::string, CachedClass>& cache){
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	size_t file_size = in ? (size_t)in.tellg() : 0;
+	in.seekg(0);
+	std::string line;
+	if(!std::getline(in, line) || line != CACHE_MAGIC)
+		return;
+	std::string tag, name;
+	while(in >> tag >> name && tag == "class"){
+		CachedClass entry;
+		size_t num_deps, num_types, num_lines, error_len;
+		in >> entry.key >> entry.error_count >> num_deps >> num_types >> num_lines >> error_len;
+		// every item takes at least a byte, so a larger count is damage
+		if(!in || num_deps > file_size || num_types > file_size || num_lines > file_size || error_len > file_size)
+			return;
+		in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		for(size_t i = 0; i < num_deps; i++){
+			std::pair<std::string, unsigned long long> dep;
+			in >> dep.first >> dep.second;
+			entry.deps.push_back(dep);
+		}
+		entry.types.resize(num_types);
+		for(size_t i = 0; i < num_types; i++)
+			in >> entry.types[i];
+		entry.error_lines.resize(num_lines);
+		for(size_t i = 0; i < num_lines; i++)
+			in >> entry.error_lines[i].first >> entry.error_lines[i].second;
+		in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		entry.errors.resize(error_len);
+		if(error_len > 0)
+			in.read(&entry.errors[0], error_len);
+		if(!in)
+			return;
+		cache[name] = entry;
+	}
+}
+
+static void write_cache(const char* path, const std::vector<std::pair<std::string, CachedClass> >& entries){
+	std::string tmp_path = std::string(path) + ".tmp";
+	std::ofstream out(tmp_path.c_str(), std::ios::binary);
+	out << CACHE_MAGIC << "\n";
+	for(size_t i = 0; i < entries.size(); i++){
+		const CachedClass& entry = entries[i].second;
+		out << "class " << entries[i].first << " " << entry.key << " " << entry.error_count << " "
+			<< entry.deps.size() << " " << entry.types.size() << " " << entry.error_lines.size() << " "
+			<< entry.errors.size() << "\n";
+		for(size_t j = 0; j < entry.deps.size(); j++)
+			out << entry.deps[j].first << " " << entry.deps[j].second << " ";
+		for(size_t j = 0; j < entry.types.size(); j++)
+			out << entry.types[j] << " ";
+		for(size_t j = 0; j < entry.error_lines.size(); j++)
+			out << entry.error_lines[j].first << " " << entry.error_lines[j].second << " ";
+		out << "\n";
+		out.write(entry.errors.data(), entry.errors.size());
+	}
+	out.close();
+	if(out)
+		rename(tmp_path.c_str(), path);
+}
+
+// Cut the line numbers semant_error() wrote into text at lines out of it,
+// for the cache; a line of a node outside the class is kept as it is.
+static void cut_error_lines(const std::string& text, const std::vector<std::pair<size_t, tree_node*> >& lines,
+	const std::vector<tree_node*>& nodes, CachedClass& entry){
+	std::unordered_map<tree_node*, size_t> position;
+	for(size_t i = 0; i < nodes.size(); i++)
+		position[nodes[i]] = i;
+	size_t from = 0;
+	for(size_t i = 0; i < lines.size(); i++){
+		std::unordered_map<tree_node*, size_t>::const_iterator iter = position.find(lines[i].second);
+		if(iter == position.end())
+			continue;
+		entry.errors.append(text, from, lines[i].first - from);
+		entry.error_lines.push_back(std::make_pair(entry.errors.size(), iter->second));
+		from = lines[i].first;
+		while(from < text.size() && isdigit((unsigned char)text[from]))
+			from++;
+	}
+	entry.errors.append(text, from, std::string::npos);
+}
+
+// whether the cached error lines fit the class's errors and nodes
+static Boolean error_lines_fit(const CachedClass& entry, size_t num_nodes){
+	size_t offset = 0;
+	for(size_t i = 0; i < entry.error_lines.size(); i++){
+		if(entry.error_lines[i].first < offset || entry.error_lines[i].first > entry.errors.size()
+			|| entry.error_lines[i].second >= num_nodes)
+			return FALSE;
+		offset = entry.error_lines[i].first;
+	}
+	return TRUE;
+}
+
+// the cached error text, with the current line of each error's node put back
+static std::string replay_errors(const CachedClass& entry, const std::vector<tree_node*>& nodes){
+	std::ostringstream text;
+	size_t from = 0;
+	for(size_t i = 0; i < entry.error_lines.size(); i++){
+		text.write(entry.errors.data() + from, entry.error_lines[i].first - from);
+		text << nodes[entry.error_lines[i].second]->get_line_number();
+		from = entry.error_lines[i].first;
+	}
+	text.write(entry.errors.data() + from, entry.errors.size() - from);
+	return text.str();
+}
+
+void ClassTable::check_type_incremental(const char* cache_path, int jobs){
+	std::unordered_map<std::string, CachedClass> cache;
+	read_cache(cache_path, cache);
+
+	// any change to the class graph invalidates everything, since subtype
+	// checks and joins depend on it
+	std::ostringstream graph;
+	for(size_t i = 0; i < declared_nodes.size(); i++)
+		graph << declared_nodes[i]->get_name() << " " << declared_nodes[i]->get_class()->get_parent() << "\n";
+	unsigned long long graph_hash = hash_string(graph.str());
+
+	// flattened interfaces: a class's own features and its ancestors'
+	std::unordered_map<ClassNode*, unsigned long long> interfaces;
+	for(size_t i = 0; i < preorder_nodes.size(); i++){
+		ClassNode* node = preorder_nodes[i];
+		unsigned long long h = node->interface_hash();
+		if(node->parent_node != NULL)
+			h = hash_combine(interfaces[node->parent_node], h);
+		interfaces[node] = h;
+	}
+
+	// names in the cache are only looked up, not entered: a name this
+	// program never uses is not one of its classes or types, and makes the
+	// entry stale
+	auto find_symbol = [](const std::string& name){
+		return (Symbol)idtable.probe_string((char*)name.c_str(), name.size());
+	};
+
+	std::vector<ClassNode*> dirty;
+	std::vector<Boolean> is_dirty(preorder_nodes.size(), FALSE);
+	std::vector<std::vector<tree_node*> > nodes(preorder_nodes.size());
+	std::vector<std::vector<Expression> > exprs(preorder_nodes.size());
+	std::vector<unsigned long long> keys(preorder_nodes.size());
+	std::unordered_map<ClassNode*, size_t> slot;
+	std::vector<std::string> errors(preorder_nodes.size());
+	std::vector<int> error_counts(preorder_nodes.size());
+	std::vector<CachedClass> class_entries(preorder_nodes.size());
+	for(size_t i = 0; i < preorder_nodes.size(); i++){
+		ClassNode* node = preorder_nodes[i];
+		slot[node] = i;
+		keys[i] = hash_combine(hash_combine(node->body_hash(nodes[i], exprs[i]), interfaces[node]), graph_hash);
+
+		std::unordered_map<std::string, CachedClass>::const_iterator iter = cache.find(node->get_name()->get_string());
+		Boolean valid = iter != cache.end() && iter->second.key == keys[i] && iter->second.types.size() == exprs[i].size()
+			&& error_lines_fit(iter->second, nodes[i].size());
+		for(size_t j = 0; valid && j < iter->second.deps.size(); j++){
+			Symbol name = find_symbol(iter->second.deps[j].first);
+			ClassNode* dep = name != NULL ? find_class(name) : NULL;
+			valid = dep != NULL && interfaces[dep] == iter->second.deps[j].second;
+		}
+		std::vector<Symbol> types;
+		for(size_t j = 0; valid && j < exprs[i].size(); j++){
+			Symbol type = iter->second.types[j] == "-" ? NULL : find_symbol(iter->second.types[j]);
+			valid = type != NULL || iter->second.types[j] == "-";
+			types.push_back(type);
+		}
+		if(!valid){
+			dirty.push_back(node);
+			is_dirty[i] = TRUE;
+			continue;
+		}
+		const CachedClass& entry = iter->second;
+		for(size_t j = 0; j < exprs[i].size(); j++)
+			exprs[i][j]->set_type(types[j]);
+		errors[i] = replay_errors(entry, nodes[i]);
+		error_counts[i] = entry.error_count;
+		semant_errors += entry.error_count;
+		class_entries[i] = entry;
+	}
+
+	std::vector<std::string> dirty_errors;
+	std::vector<int> dirty_counts;
+	std::vector<std::vector<ClassNode*> > dirty_deps;
+	std::vector<std::vector<std::pair<size_t, tree_node*> > > dirty_lines;
+	check_isolated(dirty, dirty_errors, dirty_counts, dirty_deps, &dirty_lines, jobs);
+
+	for(size_t i = 0; i < dirty.size(); i++){
+		size_t index = slot[dirty[i]];
+		errors[index] = dirty_errors[i];
+		error_counts[index] = dirty_counts[i];
+		CachedClass& entry = class_entries[index];
+		cut_error_lines(dirty_errors[i], dirty_lines[i], nodes[index], entry);
+		std::vector<ClassNode*>& deps = dirty_deps[i];
+		std::sort(deps.begin(), deps.end());
+		deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+		for(size_t j = 0; j < deps.size(); j++)
+			entry.deps.push_back(std::make_pair(std::string(deps[j]->get_name()->get_string()), interfaces[deps[j]]));
+	}
+	std::vector<std::pair<std::string, CachedClass> > entries;
+	for(size_t i = 0; i < preorder_nodes.size(); i++){
+		CachedClass& entry = class_entries[i];
+		entry.key = keys[i];
+		entry.error_count = error_counts[i];
+		entry.types.clear();
+		for(size_t j = 0; j < exprs[i].size(); j++){
+			Symbol type = exprs[i][j]->get_type();
+			entry.types.push_back(type == NULL ? "-" : type->get_string());
+		}
+		entries.push_back(std::make_pair(std::string(preorder_nodes[i]->get_name()->get_string()), entry));
+	}
+	write_cache(cache_path, entries);
+
+	for(size_t i = 0; i < declared_nodes.size(); i++){
+		std::unordered_map<ClassNode*, size_t>::const_iterator iter = slot.find(declared_nodes[i]);
+		if(iter != slot.end())
+			error_stream << errors[iter->second];
+	}
+}
 
 // SymbolTable
 
-Entry* SymbolTable::lookup(Symbol s){
-	for(int i = scope_stack_depth - 1;i >= 0;i--){
-		Scope* cur_scope = scope_stack[i];
-		if ( cur_scope->find(s) != cur_scope->end() )
-			return (*cur_scope)[s];
+void SymbolTable::addid(Symbol s, Entry* d){
+	int depth = scope_marks.size();
+	BindingStack& stack = bindings[s];
+	// rebinding in the same scope replaces the binding
+	if(!stack.empty() && stack.back().depth == depth){
+		stack.back().value = d;
+		return;
 	}
-	return NULL;
+	Binding binding = { d, depth };
+	stack.push_back(binding);
+	undo_log.push_back(s);
+}
+
+Entry* SymbolTable::lookup(Symbol s){
+	std::unordered_map<Symbol, BindingStack>::const_iterator iter = bindings.find(s);
+	if(iter == bindings.end() || iter->second.empty())
+		return NULL;
+	return iter->second.back().value;
 }
 
 Entry* SymbolTable::probe(Symbol s){
-	Scope *cur_scope = scope_stack[scope_stack_depth - 1];
-	if ( cur_scope->find(s) != cur_scope->end() )
-		return (*cur_scope)[s];
-	return NULL;
+	std::unordered_map<Symbol, BindingStack>::const_iterator iter = bindings.find(s);
+	if(iter == bindings.end() || iter->second.empty())
+		return NULL;
+	if(iter->second.back().depth != (int)scope_marks.size())
+		return NULL;
+	return iter->second.back().value;
 }
 
 Entry* SymbolTable::probe_outer(Symbol s){
-	for(int i = scope_stack_depth - 2;i >= 0;i--){
-		Scope *cur_scope = scope_stack[i];
-		if ( cur_scope->find(s) != cur_scope->end() )
-			return (*cur_scope)[s];
-	}
-	return NULL;
+	std::unordered_map<Symbol, BindingStack>::const_iterator iter = bindings.find(s);
+	if(iter == bindings.end() || iter->second.empty())
+		return NULL;
+	const BindingStack& stack = iter->second;
+	// each scope holds at most one binding of s, so the next one down is outer
+	if(stack.back().depth != (int)scope_marks.size())
+		return stack.back().value;
+	if(stack.size() < 2)
+		return NULL;
+	return stack[stack.size() - 2].value;
 }
 ////////////////////////////////////////////////////////////////////
 //
@@ -400,56 +935,48 @@ Entry* SymbolTable::probe_outer(Symbol s){
 
 ostream& semant_error(tree_node *t)
 {
-    error_stream << cur_class->get_filename() << ":" << t->get_line_number() << ": ";
-    return semant_error();
+    ostream& stream = semant_error();
+    stream << cur_class->get_filename() << ":";
+    if (class_error_lines != NULL)
+        class_error_lines->push_back(std::make_pair((size_t)stream.tellp(), t));
+    stream << t->get_line_number() << ": ";
+    return stream;
 }
 
 ostream& semant_error()                  
 {                                                 
     semant_errors++;                            
-    return error_stream;
+    class_error_count++;
+    return class_error_stream ? *class_error_stream : error_stream;
 } 
 
 
-std::vector<Symbol> get_inherit_classes(Symbol cls){
-
-	std::vector<Symbol> ancestor_cls;
-	Symbol parent_cls = cls;
-	while( parent_cls!= No_class ){
-		ancestor_cls.push_back(parent_cls);
-		parent_cls = class_table->find_class(parent_cls)->get_class()->get_parent();
-	}
-	
-	std::reverse(ancestor_cls.begin(), ancestor_cls.end());
-	return ancestor_cls;
-}
-
 Symbol get_LCA_class(Symbol cls1, Symbol cls2){
 
 	if(cls1 == SELF_TYPE) cls1 = cur_class->get_name();
 	if(cls2 == SELF_TYPE) cls2 = cur_class->get_name();
 	if(cls1 == cls2) return cls1;
 
-	std::vector<Symbol> ancestor_cls1 = get_inherit_classes(cls1);
-	std::vector<Symbol> ancestor_cls2 = get_inherit_classes(cls2);
-	
-	size_t i;
-	size_t min_depth = std::min(ancestor_cls1.size(), ancestor_cls2.size());
-	Symbol LCA_class = ancestor_cls1[min_depth-1];
-	for(i = 0; i < min_depth ; i++)
-		if(ancestor_cls1[i] != ancestor_cls2[i])
-			{ 
-				LCA_class = ancestor_cls1[i-1];
-				break;
-			}
+	ClassNode* node1 = class_table->find_class(cls1);
+	ClassNode* node2 = class_table->find_class(cls2);
+	// undefined types have already been reported
+	if(node1 == NULL || node2 == NULL) return Object;
 
-	return LCA_class;
+	return class_table->get_LCA(node1, node2)->get_name();
 }
 
 Boolean is_compatible(Symbol sub_cls, Symbol parent_cls){
-	if(sub_cls == No_type || parent_cls == No_type || get_LCA_class(sub_cls, parent_cls) == parent_cls)
+	if(sub_cls == No_type || parent_cls == No_type)
+		return TRUE;
+	if(parent_cls == SELF_TYPE)
+		return sub_cls == SELF_TYPE;
+	if(sub_cls == SELF_TYPE) sub_cls = cur_class->get_name();
+
+	ClassNode* sub_node = class_table->find_class(sub_cls);
+	ClassNode* parent_node = class_table->find_class(parent_cls);
+	if(sub_node == NULL || parent_node == NULL)
 		return TRUE;
-	return FALSE;
+	return sub_node->is_subclass_of(parent_node);
 }
 
 void class__class::is_defined(){
@@ -476,18 +1003,10 @@ void class__class::check_type(){
 
 // method
 Method method_class::get_inherit_method(){
-
-	Symbol ancestor = cur_class->get_parent();
-	Method ancestor_method = NULL;
-
-	while(ancestor != No_class){
-		ClassNode* parent_node = class_table->find_class(ancestor);
-		Method meth = parent_node->find_method(name);
-		if(meth)
-			ancestor_method = meth;
-		ancestor = parent_node->get_parent();
-	}
-	return ancestor_method;
+	ClassNode* parent_node = class_table->find_class(cur_class->get_parent());
+	if(parent_node == NULL)
+		return NULL;
+	return parent_node->find_method(name);
 }
 
 Boolean method_class::check_inherit_method(){
@@ -528,6 +1047,8 @@ Symbol method_class::check_type(){
 	method_table.enterscope();
 	identifier_table.enterscope();
 	
+	// other classes read return_type when checking dispatches, so it is not rewritten here
+	Symbol return_type = this->return_type;
 	if(return_type == SELF_TYPE)
 		return_type = cur_class->get_name();
 
@@ -560,6 +1081,7 @@ void attr_class::is_defined(){
 
 Symbol attr_class::check_type(){
 	Symbol type = init->check_type();
+	Symbol type_decl = this->type_decl;
 
 	if(name == self){
 		semant_error(this) << "attr name can not be self" << endl;
@@ -578,6 +1100,8 @@ Symbol attr_class::check_type(){
 
 // formal 
 Symbol formal_class::check_type(){
+	// the declared type stays as written; dispatches in other classes read it
+	Symbol type_decl = this->type_decl;
 	if ( name == self){
 		semant_error(this) << "Formal name can not be self" << endl;
 		type_decl = Object;
@@ -616,9 +1140,25 @@ Symbol assign_class::check_type(){
 	return type;
 }
 
+// a + b + c ... nests to the left through e1, and a.f().g() ... through
+// the receiver; check the leftmost expression and then each link on the
+// way back up
+static Symbol check_chain(Expression expr){
+	std::vector<Expression> chain;
+	for(; expr->chain_e1() != NULL; expr = expr->chain_e1())
+		chain.push_back(expr);
+
+	Symbol type = expr->check_type();
+	for(size_t i = chain.size(); i-- > 0; )
+		type = chain[i]->check_chained(type);
+	return type;
+}
+
 Symbol static_dispatch_class::check_type(){
-	Symbol expr_type = expr->check_type();
-	
+	return check_chain(this);
+}
+
+Symbol static_dispatch_class::check_chained(Symbol expr_type){
 	if(type_name != SELF_TYPE && class_table->find_class(type_name) == NULL){
 		semant_error(this) << "In static dispatch expr: Undefined type " << type_name << endl;
 		return type = Object;
@@ -662,9 +1202,14 @@ Symbol static_dispatch_class::check_type(){
 }
 
 Symbol dispatch_class::check_type(){
-	Symbol expr_type = expr->check_type();
+	return check_chain(this);
+}
 
-	Method method = class_table->find_method(expr_type, name);
+Symbol dispatch_class::check_chained(Symbol expr_type){
+	// f() and self.f() look f up in the class being checked; the result
+	// of a SELF_TYPE method is still the receiver's type, SELF_TYPE
+	Symbol receiver_class = expr_type == SELF_TYPE ? cur_class->get_name() : expr_type;
+	Method method = class_table->find_method(receiver_class, name);
 
 	if(method == NULL){
 		semant_error(this) << "In dispatch expr: No method " << name << endl;
@@ -736,6 +1281,7 @@ Symbol typcase_class::check_type(){
 Symbol branch_class::check_type(){
 	identifier_table.enterscope();
 
+	Symbol type_decl = this->type_decl;
 	if(type_decl == SELF_TYPE)
 		type_decl = cur_class->get_name();
 	identifier_table.addid(name, type_decl);
@@ -753,9 +1299,11 @@ Symbol block_class::check_type(){
 	return type;
 }
 
-Symbol let_class::check_type(){
+// enter the let's scope and check its initializer
+void let_class::check_binding(){
 	identifier_table.enterscope();
 
+	Symbol type_decl = this->type_decl;
 	if(type_decl == SELF_TYPE)
 		type_decl = cur_class->get_name();
 	identifier_table.addid(identifier, type_decl);
@@ -766,16 +1314,33 @@ Symbol let_class::check_type(){
 		semant_error(this) << "In let expr: " << identifier << " of undefine type " << type_decl  << endl; 
 	else if(!is_compatible(init_type, type_decl))
 		semant_error(this) << "In let expr: " << identifier << " declared type " << type_decl << " not compatible with runtime type " << init_type << endl; 
-	
-	type = body->check_type();
-	identifier_table.exitscope();
+}
 
+// let x1 ... in let x2 ... in ... nests through the body; the whole
+// chain is checked in one loop instead of one call per binding
+Symbol let_class::check_type(){
+	std::vector<let_class*> chain;
+	let_class* let = this;
+	while(let != NULL){
+		let->check_binding();
+		chain.push_back(let);
+		let = let->body->as_let();
+	}
+
+	Symbol body_type = chain.back()->body->check_type();
+	for(size_t i = chain.size(); i-- > 0; ){
+		chain[i]->type = body_type;
+		identifier_table.exitscope();
+	}
 	return type;
 }
 
-
 Symbol plus_class::check_type(){
-	Symbol type1 = e1->check_type(), type2 = e2->check_type();
+	return check_chain(this);
+}
+
+Symbol plus_class::check_chained(Symbol type1){
+	Symbol type2 = e2->check_type();
 	if(type1 != Int || type2 != Int)
 		semant_error(this) << "In plus expr: Invalid calculation :" << type1 << " + " << type2 << endl;
 	type = Int;
@@ -783,7 +1348,11 @@ Symbol plus_class::check_type(){
 }
 
 Symbol sub_class::check_type(){
-	Symbol type1 = e1->check_type(), type2 = e2->check_type();
+	return check_chain(this);
+}
+
+Symbol sub_class::check_chained(Symbol type1){
+	Symbol type2 = e2->check_type();
 	if(type1 != Int || type2 != Int)
 		semant_error(this) << "In sub expr: Invalid calculation :" << type1 << " - " << type2 << endl;
 	type = Int;
@@ -791,7 +1360,11 @@ Symbol sub_class::check_type(){
 }
 
 Symbol mul_class::check_type(){
-	Symbol type1 = e1->check_type(), type2 = e2->check_type();
+	return check_chain(this);
+}
+
+Symbol mul_class::check_chained(Symbol type1){
+	Symbol type2 = e2->check_type();
 	if(type1 != Int || type2 != Int)
 		semant_error(this) << "In mul expr: Invalid calculation :" << type1 << " * " << type2 << endl;
 	type = Int;
@@ -799,7 +1372,11 @@ Symbol mul_class::check_type(){
 }
 
 Symbol divide_class::check_type(){
-	Symbol type1 = e1->check_type(), type2 = e2->check_type();
+	return check_chain(this);
+}
+
+Symbol divide_class::check_chained(Symbol type1){
+	Symbol type2 = e2->check_type();
 	if(type1 != Int || type2 != Int)
 		semant_error(this) << "In div expr: Invalid calculation :" << type1 << " / " << type2 << endl;
 	type = Int;
@@ -913,20 +1490,51 @@ Symbol object_class::check_type(){
  */
 
 
-void program_class::semant()
+// check_semantics runs every check on the program and returns the number
+// of errors, or -1 if the inheritance graph is illegal (the later checks
+// assume a tree, so they are skipped). semant() is the semant phase's
+// entry point and exits on errors; the single-process compiler calls
+// check_semantics() directly.
+int program_class::check_semantics()
 {
     initialize_constants();
+	semant_errors = 0;
 
-    /* ClassTable constructor may do some semantic analysis */
-	class_table = new ClassTable(classes);
+    /* ClassTable constructor may do some semantic analysis; the table
+	   is freed when the checks are over, so the compiler can run again */
+	ClassTable table(classes);
+	class_table = &table;
 
 	/* some semantic analysis code may go here */
 	class_table->check_Main();
-	if (! class_table->is_inherit_legal()) exit(1);
+	if (! class_table->is_inherit_legal()){
+		class_table = NULL;
+		return -1;
+	}
+	class_table->number_classes();
+	class_table->build_feature_tables();
 	class_table->is_defined();
-	class_table->check_type();
+	// COOL_SEMANT_JOBS=n checks classes on n threads; COOL_SEMANT_CACHE=file
+	// only rechecks the classes that changed since the run that wrote file
+	const char* jobs = getenv("COOL_SEMANT_JOBS");
+	const char* cache = getenv("COOL_SEMANT_CACHE");
+	int num_jobs = jobs != NULL ? atoi(jobs) : 1;
+	if(cache != NULL)
+		class_table->check_type_incremental(cache, num_jobs);
+	else if(num_jobs > 1)
+		class_table->check_type_parallel(num_jobs);
+	else
+		class_table->check_type();
+
+	class_table = NULL;
+	return semant_errors;
+}
 
-	if(semant_errors){
+void program_class::semant()
+{
+	int errors = check_semantics();
+	if(errors < 0) exit(1);
+	if(errors){
 		cerr << "Compilation halted due to static semantic errors." << endl;
 		exit(1);
 	}
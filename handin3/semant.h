@@ -6,7 +6,7 @@
 #include "cool-tree.h"
 #include "stringtab.h"
 #include "list.h"
-#include <map>
+#include <unordered_map>
 #include <vector>
 #include <stack>
 #include <algorithm>
@@ -21,28 +21,37 @@
 // methods.
 
 
-typedef std::map<Symbol, Entry *> Scope;
-typedef std::vector<Scope* > ScopeStack;
+// SymbolTable keeps one hash table from each Symbol to the stack of its
+// live bindings, innermost last. Every binding made in a scope is
+// recorded in an undo log, and exitscope() pops exactly those, so
+// entering and leaving scopes allocates nothing once the stacks have
+// grown to the program's nesting depth.
+struct Binding{
+	Entry* value;
+	int depth;
+};
+typedef std::vector<Binding> BindingStack;
 
 class SymbolTable{
 private:
-	ScopeStack scope_stack;
-	int scope_stack_depth;
+	std::unordered_map<Symbol, BindingStack> bindings;
+	std::vector<Symbol> undo_log;
+	// undo_log size at each enterscope()
+	std::vector<size_t> scope_marks;
 public:
-	SymbolTable(): scope_stack_depth(0) {}
-
 	void enterscope() { 
-		scope_stack.push_back(new Scope()); 
-		scope_stack_depth++; 
+		scope_marks.push_back(undo_log.size()); 
 	}
 	void exitscope() { 
-		scope_stack.pop_back(); 
-		scope_stack_depth--; 
+		size_t mark = scope_marks.back();
+		scope_marks.pop_back();
+		while(undo_log.size() > mark){
+			bindings[undo_log.back()].pop_back();
+			undo_log.pop_back();
+		}
 	}
 
-	void addid(Symbol s, Entry* d) { 
-		(*scope_stack[scope_stack_depth - 1])[s] = d; 
-	}
+	void addid(Symbol s, Entry* d);
 	// lookup from all scopes
 	Entry* lookup(Symbol);
 	// lookup from last scope
@@ -52,16 +61,36 @@ public:
 };
 
 class ClassNode;
-std::vector<ClassNode*> class_node_path;
+
+// a feature visible in some class, together with the class defining it
+struct FeatureEntry{
+	Feature feature;
+	ClassNode* owner;
+};
+typedef std::unordered_map<Symbol, FeatureEntry> FeatureTable;
 
 class ClassNode{
+	friend class ClassTable;
 protected:
 	Class_ class_;
 	std::vector<ClassNode*> children;
 	int num_childs;
+	// resolved parent; NULL for Object and for classes with an illegal parent
+	ClassNode* parent_node;
+	Boolean in_cycle;
+
+	// filled in by ClassTable::number_classes() once the hierarchy is final
+	int preorder, postorder, depth;
+	// ancestors[k] is the 2^k-th ancestor; only entries with 2^k <= depth exist
+	std::vector<ClassNode*> ancestors;
+
+	// own and inherited features, filled in by ClassTable::build_feature_tables()
+	FeatureTable methods;
+	FeatureTable attrs;
 
 public:
-	ClassNode(Class_ c):class_(c), num_childs(0) { }
+	ClassNode(Class_ c):class_(c), num_childs(0), parent_node(NULL), in_cycle(FALSE),
+		preorder(0), postorder(0), depth(0) { }
 	~ClassNode();
 	
 	Class_ get_class() const { 
@@ -83,46 +112,29 @@ public:
 		children.push_back(child); 
 	}
 
-	ClassNode* find_child(Symbol cls) {
-		if(get_name() == cls) return this;
-		if(std::find(class_node_path.begin(), class_node_path.end(), this) != class_node_path.end())
-			return NULL;
-		class_node_path.push_back(this);
-		ClassNode* result = NULL;
-		for(int i = 0;i < num_childs;i++){
-			if( (result = children[i]->find_child(cls)) ) return result;
-		}
-		class_node_path.pop_back();
-		return result;
-	}
-
+	// methods and attributes are looked up in the flattened tables, so
+	// inherited features are found as well
 	Method find_method(Symbol method) {
-		Features features = class_->get_features();
-		for(int i = features->first(); features->more(i); i = features->next(i)){
-			if(features->nth(i)->is_attr()){
-				continue;
-			}
-			Method m = (Method)features->nth(i);
-			if(m->get_name() == method)
-				return m;
-		}
-		return NULL;
+		FeatureTable::const_iterator iter = methods.find(method);
+		if(iter == methods.end()) return NULL;
+		return (Method)iter->second.feature;
 	}
 
 	Attr find_attr(Symbol attr) {
-		Features features = class_->get_features();
-		for(int i = features->first(); features->more(i); i = features->next(i)){
-			if(! features->nth(i)->is_attr()){
-				continue;
-			}
-			Attr a = (Attr)features->nth(i);
-			if(a->get_name() == attr)
-				return a;
-		}
-		return NULL;
+		FeatureTable::const_iterator iter = attrs.find(attr);
+		if(iter == attrs.end()) return NULL;
+		return (Attr)iter->second.feature;
+	}
+	// this class is cls itself or inherits from it
+	Boolean is_subclass_of(ClassNode* cls) const {
+		return cls->preorder <= preorder && postorder <= cls->postorder;
 	}
+	void visit_subtree(void (*visit)(ClassNode*));
 	void is_defined();
 	void check_type();
+	void check_type_isolated();
+	unsigned long long body_hash(std::vector<tree_node*>& nodes, std::vector<Expression>& exprs);
+	unsigned long long interface_hash();
 };
 
 
@@ -131,26 +143,39 @@ public:
 class ClassTable{
 private:
 	std::vector<ClassNode* > root_nodes;
+	// every installed class by name, filled in by append()
+	std::unordered_map<Symbol, ClassNode*> class_index;
+	// the same classes in declaration order
+	std::vector<ClassNode*> declared_nodes;
+	// classes in preorder, parents before children; set by number_classes()
+	std::vector<ClassNode*> preorder_nodes;
 	ClassNode* main_node;
+
+	void link_classes();
+	void mark_cycles();
+	void check_isolated(const std::vector<ClassNode*>& nodes, std::vector<std::string>& errors,
+		std::vector<int>& error_counts, std::vector<std::vector<ClassNode*> >& deps,
+		std::vector<std::vector<std::pair<size_t, tree_node*> > >* error_lines, int jobs);
 public:
 	ClassTable(Classes classes);
+	~ClassTable();
 	void append(Class_ cls);
 	ClassNode* get_root();
 	void install_basic_classes();
 
-	void has_cycle();
+	void number_classes();
+	void build_feature_tables();
+	ClassNode* get_LCA(ClassNode* a, ClassNode* b);
 	
 	void is_defined();
 	void check_type();
+	void check_type_parallel(int jobs);
+	void check_type_incremental(const char* cache_path, int jobs);
 	Boolean is_inherit_legal();
 	ClassNode* find_class(Symbol cls) {
-		ClassNode* result = NULL;
-		class_node_path.clear();
-
-		for(size_t i = 0;i < root_nodes.size();i++){
-			if((result = root_nodes[i]->find_child(cls))) return result;
-		}
-		return result;
+		std::unordered_map<Symbol, ClassNode*>::const_iterator iter = class_index.find(cls);
+		if(iter == class_index.end()) return NULL;
+		return iter->second;
 	}
 	ClassNode* find_class(Class_ cls){
 		return find_class(cls->get_name());
@@ -158,23 +183,11 @@ public:
 	ClassNode* find_class(ClassNode* cls){
 		return find_class(cls->get_class());
 	}
-	Method find_method(Symbol cls, Symbol meth){
-		ClassNode* class_node = find_class(cls);
-		if(class_node == NULL) return NULL;
-		Method meth_ = class_node->find_method(meth);
-		if(meth_) return meth_;
-		else {
-			return find_method(class_node->get_parent(), meth);
-		}
-	}
+	Method find_method(Symbol cls, Symbol meth);
 	Attr find_attr(Symbol cls, Symbol attr){
 		ClassNode* class_node = find_class(cls);
 		if(class_node == NULL) return NULL;
-		Attr attr_ = class_node->find_attr(attr);
-		if(attr_) return attr_;
-		else {
-			return find_attr(class_node->get_parent(), attr);
-		}
+		return class_node->find_attr(attr);
 	}
 	void check_Main();
 
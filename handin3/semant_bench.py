@@ -0,0 +1,109 @@
+import os
+import sys
+import argparse
+import subprocess
+import tempfile
+import time
+
+# Times semant on generated programs of 1k to 100k classes.  Every class
+# has an attribute of another class's type, creates one and dispatches
+# to it, so semant looks classes up by name many times per class.
+#   wide   all classes inherit IO
+#   chain  each class inherits the one before it, in chains of a hundred
+#          (every class keeps its own copy of the features it inherits,
+#          so one chain of n classes would take memory in n * n)
+#   lookup wide, but each method also names three classes in a let, a
+#          case and static dispatches, for class lookups by name
+#   cycle  wide, but the last tenth of the classes inherit each other
+#          in cycles of five; semant must name each of them
+# The tree is made once by lexer | parser, and only semant < tree is
+# timed.  Run it where semant is built: python3 semant_bench.py
+
+parser = argparse.ArgumentParser(description = 'time semant against the number of classes')
+parser.add_argument('-l', '--lexer', default = 'lexer')
+parser.add_argument('-p', '--parser', default = 'parser')
+parser.add_argument('-s', '--semant', default = './semant')
+parser.add_argument('-m', '--modes', default = 'wide,chain,lookup,cycle')
+parser.add_argument('-n', '--classes', default = '1000,10000,100000')
+parser.add_argument('-r', '--runs', default = 3, type = int)
+args = parser.parse_args()
+
+CYCLE = 5
+CHAIN = 100
+
+# the classes that inherit each other in cycle mode
+def in_cycle(mode, n, i):
+	return mode == 'cycle' and i >= n - n // 10 // CYCLE * CYCLE
+
+def parent(mode, n, i):
+	if in_cycle(mode, n, i):
+		first = i - (i - n) % CYCLE
+		return 'C{0}'.format(first + (i - first + 1) % CYCLE)
+	if mode == 'chain' and i % CHAIN != 0:
+		return 'C{0}'.format(i - 1)
+	return 'IO'
+
+def generate(path, mode, n):
+	with open(path, 'w') as out:
+		for i in range(n):
+			j = (i * 7919 + 1) % n
+			if mode == 'lookup':
+				k = (j + 1) % n
+				m = (j + 2) % n
+				body = ('let b : C{2} <- new C{2}, c : C{3} <- new C{3}, d : C{4} <- new C{4} in\n'
+					'      case a{0} of\n'
+					'        p : C{2} => p@C{2}.f{2}(x - 1);\n'
+					'        q : C{3} => c@C{3}.f{3}(x - 1);\n'
+					'        r : C{4} => d.f{4}(x - 1);\n'
+					'        o : Object => b.f{2}(x - 1);\n'
+					'      esac').format(i, None, j, k, m)
+			else:
+				body = '{{ a{0} <- new C{1}; a{0}.f{1}(x - 1); }}'.format(i, j)
+			out.write('class C{0} inherits {1} {{\n'
+				'  a{0} : C{2};\n'
+				'  f{0}(x : Int) : Object {{\n'
+				'    if x < 1 then x else {3} fi\n'
+				'  }};\n'
+				'}};\n'.format(i, parent(mode, n, i), j, body))
+		out.write('class Main {\n'
+			'  main() : Object { (new C0).f0(3) };\n'
+			'};\n')
+
+# the best of the runs, in seconds, with semant's status and errors
+def best_time(tree):
+	best = None
+	for run in range(args.runs):
+		with open(tree) as stdin:
+			start = time.time()
+			result = subprocess.run([args.semant], stdin = stdin, stdout = subprocess.DEVNULL,
+				stderr = subprocess.PIPE, universal_newlines = True)
+			elapsed = time.time() - start
+		if best is None or elapsed < best:
+			best = elapsed
+	return best, result.returncode, result.stderr
+
+work = tempfile.mkdtemp()
+failed = False
+print('{0:>6}  {1:>8}  {2:>9}  {3:>9}'.format('mode', 'classes', 'seconds', 'us/class'))
+for mode in args.modes.split(','):
+	for n in [int(c) for c in args.classes.split(',')]:
+		source = os.path.join(work, '{0}{1}.cl'.format(mode, n))
+		tree = os.path.join(work, '{0}{1}.tree'.format(mode, n))
+		generate(source, mode, n)
+		with open(tree, 'w') as out:
+			front = '{0} {2} | {1} {2}'.format(args.lexer, args.parser, source)
+			if subprocess.call(front, shell = True, stdout = out) != 0:
+				print('Wrong!!!!!!! {0} failed on {1}'.format(front, source))
+				sys.exit(1)
+		seconds, status, errors = best_time(tree)
+		print('{0:>6}  {1:>8}  {2:>9.3f}  {3:>9.1f}'.format(mode, n, seconds, seconds * 1e6 / n))
+		cycles = sum(1 for i in range(n) if in_cycle(mode, n, i))
+		reported = errors.count('involved in a cycle')
+		if (status != 0) != (cycles > 0) or reported != cycles:
+			print('Wrong!!!!!!! semant exited with {0} and named {1} of {2} classes in cycles'.format(status, reported, cycles))
+			failed = True
+		os.remove(source)
+		os.remove(tree)
+if failed:
+	sys.exit(1)
+print('Success')
@@ -0,0 +1,58 @@
+#ifndef TREE_ARENA_H
+#define TREE_ARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+// NodeArena
+//
+// The tree constructors in cool-tree.cc allocate their nodes from the
+// current arena: a few large blocks handed out by bumping a pointer.
+// Nodes are never freed one by one; deleting an arena frees every node
+// allocated from it at once.  Until a phase installs an arena of its own
+// the nodes come from a default arena that lives as long as the program.
+//
+// Like node_lineno, the current arena is shared by the whole process, so
+// trees are built on one thread at a time.
+class NodeArena {
+public:
+	NodeArena() : next(NULL), left(0), used(0) { }
+	~NodeArena();
+
+	void* allocate(size_t size) {
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+		if(size > left)
+			new_block(size);
+		void* p = next;
+		next += size;
+		left -= size;
+		used += size;
+		return p;
+	}
+
+	// bytes handed out so far
+	size_t size() const { return used; }
+
+	static NodeArena* current() { return current_arena; }
+	// make arena the current arena; returns the one it replaces
+	static NodeArena* install(NodeArena* arena);
+
+private:
+	enum { ALIGN = sizeof(void*) > 8 ? sizeof(void*) : 8, BLOCK = 1 << 16 };
+	std::vector<char*> blocks;
+	char* next;
+	size_t left;
+	size_t used;
+
+	void new_block(size_t size);
+	static NodeArena* current_arena;
+
+	NodeArena(const NodeArena&);
+	NodeArena& operator=(const NodeArena&);
+};
+
+// new (arena) T(...) constructs a T in arena.
+inline void* operator new(size_t size, NodeArena* arena) { return arena->allocate(size); }
+inline void operator delete(void*, NodeArena*) { }
+
+#endif
@@ -0,0 +1,475 @@
+// Binary tree files: the writer, the tree nodes' write_binary, and the
+// reader.  The format is described in tree-binary.h.
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tree-binary.h"
+
+extern int node_lineno;
+
+//
+// AstWriter
+//
+template <class Elem> void AstWriter::add_table(StringTable<Elem>& table, AstTable tag){
+	for(int i = table.first(); table.more(i); i = table.next(i)){
+		Symbol s = table.lookup(i);
+		symbols.push_back((char)tag);
+		symbols.insert(symbols.end(), s->get_string(), s->get_string() + s->get_len());
+		symbols.push_back('\0');
+		symbol_list.push_back(s);
+		symbol_refs[s] = symbol_list.size();
+	}
+}
+
+AstWriter::AstWriter(bool typed, bool whole_tables) : typed(typed), whole_tables(whole_tables){
+	if(whole_tables){
+		add_table(idtable, AST_ID);
+		add_table(inttable, AST_INT);
+		add_table(stringtable, AST_STRING);
+	}
+}
+
+uint32_t AstWriter::symbol(Symbol s){
+	std::unordered_map<Symbol, uint32_t>::const_iterator iter = symbol_refs.find(s);
+	if(iter != symbol_refs.end())
+		return iter->second;
+	if(whole_tables || s == NULL)
+		return 0;
+	// which table s is in does not matter to a tree that is not written
+	symbols.insert(symbols.end(), s->get_string(), s->get_string() + s->get_len());
+	symbols.push_back('\0');
+	symbol_list.push_back(s);
+	return symbol_refs[s] = symbol_list.size();
+}
+
+uint32_t AstWriter::node(AstKind kind, tree_node* n, Symbol type,
+	uint32_t f0, uint32_t f1, uint32_t f2, uint32_t f3){
+	AstRecord r;
+	r.kind = kind;
+	r.line = n->get_line_number();
+	r.type = typed ? symbol(type) : 0;
+	r.field[0] = f0;
+	r.field[1] = f1;
+	r.field[2] = f2;
+	r.field[3] = f3;
+	nodes.push_back(r);
+	tree_nodes.push_back(n);
+	return nodes.size() - 1;
+}
+
+bool AstWriter::write(const char* path, uint32_t root){
+	while(symbols.size() % 4 != 0)
+		symbols.push_back('\0');
+
+	AstHeader h;
+	h.magic = AST_MAGIC;
+	h.version = AST_VERSION;
+	h.flags = typed ? AST_TYPED : 0;
+	h.nsymbols = symbol_refs.size();
+	h.symbols_size = symbols.size();
+	h.nnodes = nodes.size();
+	h.nchildren = children.size();
+	h.root = root;
+
+	FILE* out = fopen(path, "wb");
+	if(out == NULL){
+		cerr << "Could not open " << path << " for writing" << endl;
+		return false;
+	}
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1
+		&& fwrite(symbols.data(), 1, symbols.size(), out) == symbols.size()
+		&& fwrite(nodes.data(), sizeof(AstRecord), nodes.size(), out) == nodes.size()
+		&& fwrite(children.data(), sizeof(uint32_t), children.size(), out) == children.size();
+	if(fclose(out) != 0)
+		ok = false;
+	if(!ok)
+		cerr << "Could not write " << path << endl;
+	return ok;
+}
+
+bool write_binary_tree(Program program, const char* path, bool typed){
+	AstWriter writer(typed);
+	uint32_t root = program->write_binary(writer);
+	return writer.write(path, root);
+}
+
+//
+// write_binary of every node: children first, then the node itself
+//
+uint32_t program_class::write_binary(AstWriter& w){
+	uint32_t c = w.list(AST_CLASSES, classes);
+	return w.node(AST_PROGRAM, this, NULL, c);
+}
+
+uint32_t class__class::write_binary(AstWriter& w){
+	uint32_t n = w.symbol(name), p = w.symbol(parent);
+	uint32_t f = w.list(AST_FEATURES, features);
+	uint32_t file = w.symbol(filename);
+	return w.node(AST_CLASS, this, NULL, n, p, f, file);
+}
+
+uint32_t method_class::write_binary(AstWriter& w){
+	uint32_t n = w.symbol(name);
+	uint32_t f = w.list(AST_FORMALS, formals);
+	uint32_t t = w.symbol(return_type);
+	uint32_t e = expr->write_binary(w);
+	return w.node(AST_METHOD, this, NULL, n, f, t, e);
+}
+
+uint32_t attr_class::write_binary(AstWriter& w){
+	uint32_t n = w.symbol(name), t = w.symbol(type_decl);
+	uint32_t e = init->write_binary(w);
+	return w.node(AST_ATTR, this, NULL, n, t, e);
+}
+
+uint32_t formal_class::write_binary(AstWriter& w){
+	uint32_t n = w.symbol(name), t = w.symbol(type_decl);
+	return w.node(AST_FORMAL, this, NULL, n, t);
+}
+
+uint32_t branch_class::write_binary(AstWriter& w){
+	uint32_t n = w.symbol(name), t = w.symbol(type_decl);
+	uint32_t e = expr->write_binary(w);
+	return w.node(AST_BRANCH, this, type, n, t, e);
+}
+
+uint32_t assign_class::write_binary(AstWriter& w){
+	uint32_t n = w.symbol(name);
+	uint32_t e = expr->write_binary(w);
+	return w.node(AST_ASSIGN, this, type, n, e);
+}
+
+// a + b + c ... and a.f().g() ... nest to the left (see check_chain in
+// semant.cc); write the leftmost expression and then each link on the way
+// back up
+static uint32_t write_chain(Expression expr, AstWriter& w){
+	std::vector<Expression> chain;
+	for(; expr->chain_e1() != NULL; expr = expr->chain_e1())
+		chain.push_back(expr);
+
+	uint32_t e1 = expr->write_binary(w);
+	for(size_t i = chain.size(); i-- > 0; )
+		e1 = chain[i]->write_chained(w, e1);
+	return e1;
+}
+
+uint32_t static_dispatch_class::write_binary(AstWriter& w){
+	return write_chain(this, w);
+}
+
+uint32_t static_dispatch_class::write_chained(AstWriter& w, uint32_t e){
+	uint32_t t = w.symbol(type_name), n = w.symbol(name);
+	uint32_t a = w.list(AST_EXPRESSIONS, actual);
+	return w.node(AST_STATIC_DISPATCH, this, type, e, t, n, a);
+}
+
+uint32_t dispatch_class::write_binary(AstWriter& w){
+	return write_chain(this, w);
+}
+
+uint32_t dispatch_class::write_chained(AstWriter& w, uint32_t e){
+	uint32_t n = w.symbol(name);
+	uint32_t a = w.list(AST_EXPRESSIONS, actual);
+	return w.node(AST_DISPATCH, this, type, e, n, a);
+}
+
+uint32_t cond_class::write_binary(AstWriter& w){
+	uint32_t p = pred->write_binary(w);
+	uint32_t t = then_exp->write_binary(w);
+	uint32_t e = else_exp->write_binary(w);
+	return w.node(AST_COND, this, type, p, t, e);
+}
+
+uint32_t loop_class::write_binary(AstWriter& w){
+	uint32_t p = pred->write_binary(w);
+	uint32_t b = body->write_binary(w);
+	return w.node(AST_LOOP, this, type, p, b);
+}
+
+uint32_t typcase_class::write_binary(AstWriter& w){
+	uint32_t e = expr->write_binary(w);
+	uint32_t c = w.list(AST_CASES, cases);
+	return w.node(AST_TYPCASE, this, type, e, c);
+}
+
+uint32_t block_class::write_binary(AstWriter& w){
+	uint32_t b = w.list(AST_EXPRESSIONS, body);
+	return w.node(AST_BLOCK, this, type, b);
+}
+
+// a let chain in one loop: the inits on the way down, then the body, then
+// the lets on the way back up
+uint32_t let_class::write_binary(AstWriter& w){
+	std::vector<let_class*> chain;
+	std::vector<uint32_t> inits;
+	Expression body = this;
+	for(let_class* let = this; let != NULL; let = body->as_let()){
+		// numbers the symbols in the order they are used in
+		w.symbol(let->identifier);
+		w.symbol(let->type_decl);
+		inits.push_back(let->init->write_binary(w));
+		chain.push_back(let);
+		body = let->body;
+	}
+
+	uint32_t b = body->write_binary(w);
+	for(size_t i = chain.size(); i-- > 0; ){
+		let_class* let = chain[i];
+		b = w.node(AST_LET, let, let->type, w.symbol(let->identifier), w.symbol(let->type_decl), inits[i], b);
+	}
+	return b;
+}
+
+#define WRITE_BINARY_2(cls, kind)                      \
+uint32_t cls::write_binary(AstWriter& w){              \
+	uint32_t a = e1->write_binary(w);              \
+	uint32_t b = e2->write_binary(w);              \
+	return w.node(kind, this, type, a, b);         \
+}
+
+#define WRITE_BINARY_CHAINED(cls, kind)                \
+uint32_t cls::write_binary(AstWriter& w){              \
+	return write_chain(this, w);                   \
+}                                                      \
+uint32_t cls::write_chained(AstWriter& w, uint32_t a){ \
+	uint32_t b = e2->write_binary(w);              \
+	return w.node(kind, this, type, a, b);         \
+}
+
+#define WRITE_BINARY_1(cls, kind)                      \
+uint32_t cls::write_binary(AstWriter& w){              \
+	uint32_t a = e1->write_binary(w);              \
+	return w.node(kind, this, type, a);            \
+}
+
+WRITE_BINARY_CHAINED(plus_class, AST_PLUS)
+WRITE_BINARY_CHAINED(sub_class, AST_SUB)
+WRITE_BINARY_CHAINED(mul_class, AST_MUL)
+WRITE_BINARY_CHAINED(divide_class, AST_DIVIDE)
+WRITE_BINARY_1(neg_class, AST_NEG)
+WRITE_BINARY_2(lt_class, AST_LT)
+WRITE_BINARY_2(eq_class, AST_EQ)
+WRITE_BINARY_2(leq_class, AST_LEQ)
+WRITE_BINARY_1(comp_class, AST_COMP)
+WRITE_BINARY_1(isvoid_class, AST_ISVOID)
+
+uint32_t int_const_class::write_binary(AstWriter& w){
+	return w.node(AST_INT_CONST, this, type, w.symbol(token));
+}
+
+uint32_t bool_const_class::write_binary(AstWriter& w){
+	return w.node(AST_BOOL_CONST, this, type, val);
+}
+
+uint32_t string_const_class::write_binary(AstWriter& w){
+	return w.node(AST_STRING_CONST, this, type, w.symbol(token));
+}
+
+uint32_t new__class::write_binary(AstWriter& w){
+	return w.node(AST_NEW, this, type, w.symbol(type_name));
+}
+
+uint32_t no_expr_class::write_binary(AstWriter& w){
+	return w.node(AST_NO_EXPR, this, type);
+}
+
+uint32_t object_class::write_binary(AstWriter& w){
+	return w.node(AST_OBJECT, this, type, w.symbol(name));
+}
+
+//
+// The reader
+//
+// Every field is checked against the file before it is used, so a
+// truncated or foreign file is reported instead of building a broken
+// tree.
+class AstReader {
+public:
+	AstReader(const AstRecord* records, const uint32_t* children, uint32_t nchildren)
+		: records(records), children(children), nchildren(nchildren), current(0), ok(true) { }
+
+	std::vector<Symbol> symbols;
+	std::vector<char> tables;	// the AstTable of each symbol
+	std::vector<tree_node*> built;
+	const AstRecord* records;
+	const uint32_t* children;
+	uint32_t nchildren;
+	uint32_t current;	// the node being built; its children come before it
+	bool ok;
+
+	// a symbol, which must be from the given table: the constants are
+	// looked up again in the tables their tokens belong to
+	Symbol sym(uint32_t ref, AstTable table = AST_ID){
+		if(ref == 0 || ref > symbols.size() || tables[ref - 1] != table){
+			ok = false;
+			return NULL;
+		}
+		return symbols[ref - 1];
+	}
+	// a type, which an untyped tree does not have
+	Symbol type(uint32_t ref){
+		return ref == 0 ? (Symbol)NULL : sym(ref);
+	}
+	tree_node* child(uint32_t i, AstKind first, AstKind last){
+		if(i >= current || records[i].kind < (uint32_t)first || records[i].kind > (uint32_t)last){
+			ok = false;
+			return NULL;
+		}
+		return built[i];
+	}
+	Expression expr(uint32_t i) { return static_cast<Expression>(child(i, AST_ASSIGN, AST_OBJECT)); }
+	Classes classes(uint32_t i) { return static_cast<Classes>(child(i, AST_CLASSES, AST_CLASSES)); }
+	Features features(uint32_t i) { return static_cast<Features>(child(i, AST_FEATURES, AST_FEATURES)); }
+	Formals formals(uint32_t i) { return static_cast<Formals>(child(i, AST_FORMALS, AST_FORMALS)); }
+	Expressions expressions(uint32_t i) { return static_cast<Expressions>(child(i, AST_EXPRESSIONS, AST_EXPRESSIONS)); }
+	Cases cases(uint32_t i) { return static_cast<Cases>(child(i, AST_CASES, AST_CASES)); }
+
+	template <class Elem> list_node<Elem>* list(const AstRecord& r, AstKind first, AstKind last,
+		list_node<Elem>* nil, list_node<Elem>* (*single)(Elem),
+		list_node<Elem>* (*append)(list_node<Elem>*, list_node<Elem>*)){
+		uint32_t start = r.field[0], count = r.field[1];
+		if(start > nchildren || count > nchildren - start){
+			ok = false;
+			return nil;
+		}
+		list_node<Elem>* l = nil;
+		for(uint32_t i = 0; i < count; i++)
+			l = append(l, single(static_cast<Elem>(child(children[start + i], first, last))));
+		return l;
+	}
+
+	tree_node* build(const AstRecord& r);
+};
+
+tree_node* AstReader::build(const AstRecord& r){
+	const uint32_t* f = r.field;
+	switch(r.kind){
+	case AST_PROGRAM: return program(classes(f[0]));
+	case AST_CLASS: return class_(sym(f[0]), sym(f[1]), features(f[2]), sym(f[3], AST_STRING));
+	case AST_METHOD: return method(sym(f[0]), formals(f[1]), sym(f[2]), expr(f[3]));
+	case AST_ATTR: return attr(sym(f[0]), sym(f[1]), expr(f[2]));
+	case AST_FORMAL: return formal(sym(f[0]), sym(f[1]));
+	case AST_BRANCH: return branch(sym(f[0]), sym(f[1]), expr(f[2]));
+	case AST_ASSIGN: return assign(sym(f[0]), expr(f[1]));
+	case AST_STATIC_DISPATCH: return static_dispatch(expr(f[0]), sym(f[1]), sym(f[2]), expressions(f[3]));
+	case AST_DISPATCH: return dispatch(expr(f[0]), sym(f[1]), expressions(f[2]));
+	case AST_COND: return cond(expr(f[0]), expr(f[1]), expr(f[2]));
+	case AST_LOOP: return loop(expr(f[0]), expr(f[1]));
+	case AST_TYPCASE: return typcase(expr(f[0]), cases(f[1]));
+	case AST_BLOCK: return block(expressions(f[0]));
+	case AST_LET: return let(sym(f[0]), sym(f[1]), expr(f[2]), expr(f[3]));
+	case AST_PLUS: return plus(expr(f[0]), expr(f[1]));
+	case AST_SUB: return sub(expr(f[0]), expr(f[1]));
+	case AST_MUL: return mul(expr(f[0]), expr(f[1]));
+	case AST_DIVIDE: return divide(expr(f[0]), expr(f[1]));
+	case AST_NEG: return neg(expr(f[0]));
+	case AST_LT: return lt(expr(f[0]), expr(f[1]));
+	case AST_EQ: return eq(expr(f[0]), expr(f[1]));
+	case AST_LEQ: return leq(expr(f[0]), expr(f[1]));
+	case AST_COMP: return comp(expr(f[0]));
+	case AST_INT_CONST: return int_const(sym(f[0], AST_INT));
+	case AST_BOOL_CONST: return bool_const(f[0] != 0);
+	case AST_STRING_CONST: return string_const(sym(f[0], AST_STRING));
+	case AST_NEW: return new_(sym(f[0]));
+	case AST_ISVOID: return isvoid(expr(f[0]));
+	case AST_NO_EXPR: return no_expr();
+	case AST_OBJECT: return object(sym(f[0]));
+	case AST_CLASSES: return list<Class_>(r, AST_CLASS, AST_CLASS, nil_Classes(), single_Classes, append_Classes);
+	case AST_FEATURES: return list<Feature>(r, AST_METHOD, AST_ATTR, nil_Features(), single_Features, append_Features);
+	case AST_FORMALS: return list<Formal>(r, AST_FORMAL, AST_FORMAL, nil_Formals(), single_Formals, append_Formals);
+	case AST_EXPRESSIONS: return list<Expression>(r, AST_ASSIGN, AST_OBJECT, nil_Expressions(), single_Expressions, append_Expressions);
+	case AST_CASES: return list<Case>(r, AST_BRANCH, AST_BRANCH, nil_Cases(), single_Cases, append_Cases);
+	}
+	ok = false;
+	return NULL;
+}
+
+Program read_binary_tree(const char* path, bool* typed){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		cerr << "Could not open input file " << path << endl;
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(AstHeader)){
+		close(fd);
+		cerr << path << " is not a binary tree file" << endl;
+		return NULL;
+	}
+	size_t size = st.st_size;
+	void* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED){
+		cerr << "Could not map " << path << endl;
+		return NULL;
+	}
+
+	const char* p = (const char*)base;
+	const AstHeader* h = (const AstHeader*)p;
+	// a symbol takes at least its table byte and its '\0'
+	if(h->magic != AST_MAGIC || h->version != AST_VERSION || h->symbols_size % 4 != 0
+		|| h->nsymbols > h->symbols_size / 2
+		|| size != sizeof(AstHeader) + (size_t)h->symbols_size
+			+ (size_t)h->nnodes * sizeof(AstRecord) + (size_t)h->nchildren * sizeof(uint32_t)
+		|| h->root >= h->nnodes){
+		munmap(base, size);
+		cerr << path << " is not a binary tree file" << endl;
+		return NULL;
+	}
+	const char* sym = p + sizeof(AstHeader);
+	const char* sym_end = sym + h->symbols_size;
+	const AstRecord* records = (const AstRecord*)sym_end;
+	const uint32_t* children = (const uint32_t*)(records + h->nnodes);
+
+	AstReader reader(records, children, h->nchildren);
+	reader.symbols.reserve(h->nsymbols);
+	reader.tables.reserve(h->nsymbols);
+	for(uint32_t i = 0; i < h->nsymbols && reader.ok; i++){
+		const char* end = sym < sym_end ? (const char*)memchr(sym + 1, '\0', sym_end - sym - 1) : NULL;
+		if(end == NULL){
+			reader.ok = false;
+			break;
+		}
+		char* s = (char*)sym + 1;
+		int len = end - s;
+		switch(*sym){
+		case AST_ID: reader.symbols.push_back(idtable.add_string(s, len)); break;
+		case AST_INT: reader.symbols.push_back(inttable.add_string(s, len)); break;
+		case AST_STRING: reader.symbols.push_back(stringtable.add_string(s, len)); break;
+		default: reader.ok = false;
+		}
+		reader.tables.push_back(*sym);
+		sym = end + 1;
+	}
+
+	int saved_lineno = node_lineno;
+	reader.built.resize(h->nnodes);
+	for(uint32_t i = 0; i < h->nnodes && reader.ok; i++){
+		const AstRecord& r = records[i];
+		reader.current = i;
+		node_lineno = r.line;
+		tree_node* n = reader.build(r);
+		if(!reader.ok)
+			break;
+		if(r.kind >= AST_ASSIGN && r.kind <= AST_OBJECT)
+			static_cast<Expression>(n)->set_type(reader.type(r.type));
+		else if(r.kind == AST_BRANCH)
+			static_cast<Case>(n)->type = reader.type(r.type);
+		reader.built[i] = n;
+	}
+	node_lineno = saved_lineno;
+
+	Program result = NULL;
+	if(reader.ok && records[h->root].kind == AST_PROGRAM){
+		result = static_cast<Program>(reader.built[h->root]);
+		if(typed != NULL)
+			*typed = (h->flags & AST_TYPED) != 0;
+	} else
+		cerr << path << " is not a binary tree file" << endl;
+	munmap(base, size);
+	return result;
+}
@@ -0,0 +1,123 @@
+#ifndef TREE_BINARY_H
+#define TREE_BINARY_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "cool-tree.h"
+
+// Binary trees
+//
+// dump_with_types prints a tree as text for the next phase to parse
+// again.  A binary tree file holds the same tree in a form that is read
+// back without tokenizing anything:
+//
+//	AstHeader
+//	symbols		nsymbols entries, the whole of idtable, inttable
+//			and stringtable in the order they were added: the
+//			table (AST_ID, AST_INT or AST_STRING) in one byte,
+//			then the NUL-terminated string; padded to 4 bytes
+//	nodes		nnodes AstRecords, every node after its children
+//	children	nchildren node indices, the elements of the lists
+//
+// A record's fields are node indices, symbol references (0 for NULL,
+// i + 1 for symbol i) or, for bool_const, the value; a list's record
+// holds the offset of its first element in children and its length.
+// Trees written after semant (AST_TYPED) carry the types of the
+// expressions and case branches as well.  Reading the symbols back in
+// order gives the tables the order they had, so cgen lays out the
+// constants of a tree it reads as it would those of the tree written.
+//
+// Numbers are in the byte order of the machine that wrote the file.
+// The text of dump_with_types is still the form to read a tree in: a
+// tree read from a binary file dumps the same as the tree written.
+
+enum AstKind {
+	AST_PROGRAM, AST_CLASS, AST_METHOD, AST_ATTR, AST_FORMAL, AST_BRANCH,
+	AST_ASSIGN, AST_STATIC_DISPATCH, AST_DISPATCH, AST_COND, AST_LOOP,
+	AST_TYPCASE, AST_BLOCK, AST_LET, AST_PLUS, AST_SUB, AST_MUL,
+	AST_DIVIDE, AST_NEG, AST_LT, AST_EQ, AST_LEQ, AST_COMP, AST_INT_CONST,
+	AST_BOOL_CONST, AST_STRING_CONST, AST_NEW, AST_ISVOID, AST_NO_EXPR,
+	AST_OBJECT,
+	AST_CLASSES, AST_FEATURES, AST_FORMALS, AST_EXPRESSIONS, AST_CASES,
+	AST_KINDS
+};
+
+enum AstTable { AST_ID, AST_INT, AST_STRING };
+
+enum { AST_MAGIC = 0x54534143, AST_VERSION = 1, AST_TYPED = 1 };
+
+struct AstHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t nsymbols;
+	uint32_t symbols_size;	// bytes, including the padding
+	uint32_t nnodes;
+	uint32_t nchildren;
+	uint32_t root;
+};
+
+struct AstRecord {
+	uint32_t kind;
+	uint32_t line;
+	uint32_t type;
+	uint32_t field[4];
+};
+
+// Every tree node's write_binary(AstWriter&) adds its children and then
+// itself to the writer and returns its own index.  Without whole_tables
+// the symbols are only those the nodes use, numbered as they are first
+// used, so that what is written depends on nothing outside the tree; such
+// a writer is for looking at (see ClassNode::body_hash), not for write().
+class AstWriter {
+public:
+	AstWriter(bool typed, bool whole_tables = true);
+
+	uint32_t symbol(Symbol s);
+	uint32_t node(AstKind kind, tree_node* n, Symbol type,
+		uint32_t f0 = 0, uint32_t f1 = 0, uint32_t f2 = 0, uint32_t f3 = 0);
+
+	template <class Elem> uint32_t list(AstKind kind, list_node<Elem>* l) {
+		std::vector<uint32_t> elems;
+		for(int i = l->first(); l->more(i); i = l->next(i))
+			elems.push_back(l->nth(i)->write_binary(*this));
+		uint32_t first = children.size();
+		children.insert(children.end(), elems.begin(), elems.end());
+		return node(kind, l, NULL, first, elems.size());
+	}
+
+	// false, with the reason on cerr, if path cannot be written
+	bool write(const char* path, uint32_t root);
+
+	// what has been added so far (see FlatTree)
+	const std::vector<AstRecord>& get_nodes() const { return nodes; }
+	const std::vector<uint32_t>& get_children() const { return children; }
+	const std::vector<tree_node*>& get_tree_nodes() const { return tree_nodes; }
+	const std::vector<Symbol>& get_symbols() const { return symbol_list; }
+	const std::vector<char>& get_symbol_text() const { return symbols; }
+
+private:
+	bool typed;
+	bool whole_tables;
+	std::unordered_map<Symbol, uint32_t> symbol_refs;
+	std::vector<Symbol> symbol_list;	// by reference - 1
+	std::vector<char> symbols;
+
+	template <class Elem> void add_table(StringTable<Elem>& table, AstTable tag);
+	std::vector<AstRecord> nodes;
+	std::vector<tree_node*> tree_nodes;	// the node each record was written from
+	std::vector<uint32_t> children;
+};
+
+// Write program to path; a typed tree keeps the types semant has set.
+bool write_binary_tree(Program program, const char* path, bool typed);
+
+// The tree in the file written by write_binary_tree, built with the tree
+// constructors; *typed, unless typed is NULL, says whether it carries
+// types.  NULL, with the reason on cerr, if path is not such a file.
+// Only the indices are checked: a tree read back is not known to be
+// well typed until semant has checked it.
+Program read_binary_tree(const char* path, bool* typed);
+
+#endif
@@ -0,0 +1,92 @@
+// FlatTree: a typed program in parallel arrays (see tree-flat.h).
+
+#include "tree-flat.h"
+
+// For every kind, the fields that hold child node numbers: bit k set
+// for field k.  Lists hold theirs in elements instead.
+static const unsigned char child_fields[AST_KINDS] = {
+	1 << 0,				// AST_PROGRAM: classes
+	1 << 2,				// AST_CLASS: features
+	1 << 1 | 1 << 3,		// AST_METHOD: formals, expr
+	1 << 2,				// AST_ATTR: init
+	0,				// AST_FORMAL
+	1 << 2,				// AST_BRANCH: expr
+	1 << 1,				// AST_ASSIGN: expr
+	1 << 0 | 1 << 3,		// AST_STATIC_DISPATCH: expr, actual
+	1 << 0 | 1 << 2,		// AST_DISPATCH: expr, actual
+	1 << 0 | 1 << 1 | 1 << 2,	// AST_COND
+	1 << 0 | 1 << 1,		// AST_LOOP
+	1 << 0 | 1 << 1,		// AST_TYPCASE: expr, cases
+	1 << 0,				// AST_BLOCK: body
+	1 << 2 | 1 << 3,		// AST_LET: init, body
+	1 << 0 | 1 << 1,		// AST_PLUS
+	1 << 0 | 1 << 1,		// AST_SUB
+	1 << 0 | 1 << 1,		// AST_MUL
+	1 << 0 | 1 << 1,		// AST_DIVIDE
+	1 << 0,				// AST_NEG
+	1 << 0 | 1 << 1,		// AST_LT
+	1 << 0 | 1 << 1,		// AST_EQ
+	1 << 0 | 1 << 1,		// AST_LEQ
+	1 << 0,				// AST_COMP
+	0, 0, 0, 0,			// AST_INT_CONST .. AST_NEW
+	1 << 0,				// AST_ISVOID
+	0, 0,				// AST_NO_EXPR, AST_OBJECT
+	0, 0, 0, 0, 0			// the lists
+};
+
+static bool is_list(uint32_t kind){
+	return kind >= AST_CLASSES && kind <= AST_CASES;
+}
+
+FlatTree::FlatTree(Program program){
+	AstWriter writer(true);
+	root = program->write_binary(writer);
+
+	const std::vector<AstRecord>& records = writer.get_nodes();
+	uint32_t n = records.size();
+	kind.resize(n);
+	type.resize(n);
+	line.resize(n);
+	for(int k = 0; k < 4; k++)
+		fields[k].resize(n);
+	symbols = writer.get_symbols();
+	elements = writer.get_children();
+	node = writer.get_tree_nodes();
+	for(uint32_t i = 0; i < n; i++){
+		const AstRecord& r = records[i];
+		kind[i] = r.kind;
+		type[i] = symbol(r.type);
+		line[i] = r.line;
+		for(int k = 0; k < 4; k++)
+			fields[k][i] = r.field[k];
+	}
+
+	// children come before their parent, so first[] is final by the time
+	// a parent reads it
+	first.resize(n);
+	parent.resize(n);
+	parent[root] = root;
+	std::vector<uint32_t> children;
+	for(uint32_t i = 0; i < n; i++){
+		first[i] = i;
+		children.clear();
+		children_of(i, children);
+		for(size_t j = 0; j < children.size(); j++){
+			parent[children[j]] = i;
+			if(first[children[j]] < first[i])
+				first[i] = first[children[j]];
+		}
+	}
+}
+
+void FlatTree::children_of(uint32_t i, std::vector<uint32_t>& out) const {
+	if(is_list(kind[i])){
+		uint32_t start = fields[0][i], count = fields[1][i];
+		out.insert(out.end(), elements.begin() + start, elements.begin() + start + count);
+		return;
+	}
+	unsigned mask = child_fields[kind[i]];
+	for(int k = 0; k < 4; k++)
+		if(mask & (1 << k))
+			out.push_back(fields[k][i]);
+}
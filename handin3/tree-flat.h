@@ -0,0 +1,46 @@
+#ifndef TREE_FLAT_H
+#define TREE_FLAT_H
+
+#include "tree-binary.h"
+
+// FlatTree
+//
+// A typed program lowered, after semant, to parallel arrays indexed by
+// node number, for whole-program passes that would otherwise chase the
+// tree's pointers through virtual check_type() and code() calls.
+//
+// Nodes are numbered as in a binary tree file (tree-binary.h): every
+// node comes after its children, so a loop from 0 to size() visits the
+// program bottom up, and the nodes of the subtree of node i are exactly
+// first[i] .. i.  fields[k][i] is field k of node i's AstRecord: a node
+// number, a symbol reference (see symbol()), or a list's elements; for
+// a node's children use children_of().  node[i] is the tree node that
+// node i was lowered from, for passes that annotate the tree.
+//
+// coolc lowers the program once semant is done and hands it to cgen,
+// whose class hierarchy analysis (analyze_dispatches) is such a pass.
+class FlatTree {
+public:
+	FlatTree(Program program);
+
+	uint32_t size() const { return kind.size(); }
+	Symbol symbol(uint32_t ref) const { return ref == 0 ? (Symbol)NULL : symbols[ref - 1]; }
+
+	// the children of node i, in order, appended to out
+	void children_of(uint32_t i, std::vector<uint32_t>& out) const;
+
+	std::vector<uint8_t> kind;	// AstKind
+	std::vector<Symbol> type;	// the type semant gave, if any
+	std::vector<uint32_t> line;
+	std::vector<uint32_t> first;	// the first node of i's subtree
+	std::vector<uint32_t> parent;	// root's parent is root
+	std::vector<uint32_t> fields[4];
+	std::vector<tree_node*> node;
+	uint32_t root;
+
+private:
+	std::vector<uint32_t> elements;	// of the lists: see AstRecord
+	std::vector<Symbol> symbols;
+};
+
+#endif
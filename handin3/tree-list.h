@@ -0,0 +1,113 @@
+#ifndef TREE_LIST_H
+#define TREE_LIST_H
+
+#include "tree.h"
+#include "tree-arena.h"
+#include <string.h>
+
+// array_node
+//
+// The lists the tree constructors in cool-tree.cc build.  tree.h's
+// append_node is a cons cell, so its nth(i) and len() walk the list and
+// the usual
+//
+//	for(i = l->first(); l->more(i); i = l->next(i)) ... l->nth(i) ...
+//
+// loop is quadratic in the length of the list.  An array_node keeps its
+// elements in an array instead, and nth(i) and len() are O(1).
+//
+// Lists are values: append(l1, l2) never changes l1.  The parser builds
+// every list by appending one element at a time to the list it has just
+// built, though, so nodes share their array: a node is a prefix of the
+// array, and appending to the node that owns the whole array adds to the
+// array in place.  Only appending to a shorter prefix copies.
+//
+// Nodes and arrays are allocated in the current NodeArena.
+template <class Elem> class array_node : public list_node<Elem> {
+	struct Array {
+		Elem* elems;
+		int size;
+		int capacity;
+	};
+	Array* array;
+	int length;
+
+	array_node(Array* a, int len) : array(a), length(len) { }
+
+	static Array* new_array(int capacity) {
+		NodeArena* arena = NodeArena::current();
+		Array* a = (Array*) arena->allocate(sizeof(Array));
+		a->elems = (Elem*) arena->allocate(capacity * sizeof(Elem));
+		a->size = 0;
+		a->capacity = capacity;
+		return a;
+	}
+
+	// Element i of l.  Not nth(), which takes a NULL element for the end
+	// of the list: the parser's error rules give NULL elements.
+	static Elem element(list_node<Elem>* l, int i) {
+		int len;
+		return l->nth_length(i, len);
+	}
+
+	static void grow(Array* a, int size) {
+		if(size <= a->capacity)
+			return;
+		int capacity = a->capacity * 2 > size ? a->capacity * 2 : size;
+		Elem* elems = (Elem*) NodeArena::current()->allocate(capacity * sizeof(Elem));
+		memcpy(elems, a->elems, a->size * sizeof(Elem));
+		a->elems = elems;
+		a->capacity = capacity;
+	}
+
+public:
+	list_node<Elem>* copy_list() {
+		if(length == 0)
+			return nil();
+		Array* a = new_array(length);
+		for(int i = 0; i < length; i++)
+			a->elems[i] = (Elem) array->elems[i]->copy();
+		a->size = length;
+		return new (NodeArena::current()) array_node<Elem>(a, length);
+	}
+	int len() { return length; }
+	Elem nth_length(int n, int& len) {
+		len = length;
+		if(n < 0 || n >= length)
+			return NULL;
+		return array->elems[n];
+	}
+	void dump(ostream& stream, int n) {
+		for(int i = 0; i < length; i++)
+			array->elems[i]->dump(stream, n);
+	}
+
+	static list_node<Elem>* nil() {
+		return new (NodeArena::current()) array_node<Elem>(NULL, 0);
+	}
+	static list_node<Elem>* single(Elem e) {
+		Array* a = new_array(4);
+		a->elems[0] = e;
+		a->size = 1;
+		return new (NodeArena::current()) array_node<Elem>(a, 1);
+	}
+	static list_node<Elem>* append(list_node<Elem>* l1, list_node<Elem>* l2) {
+		int len1 = l1->len(), len2 = l2->len();
+		array_node<Elem>* a1 = dynamic_cast<array_node<Elem>*>(l1);
+		Array* a;
+		if(a1 != NULL && a1->array != NULL && a1->array->size == len1) {
+			a = a1->array;
+			grow(a, len1 + len2);
+		} else {
+			a = new_array(len1 + len2 > 4 ? len1 + len2 : 4);
+			for(int i = 0; i < len1; i++)
+				a->elems[i] = element(l1, i);
+		}
+		for(int i = 0; i < len2; i++)
+			a->elems[len1 + i] = element(l2, i);
+		a->size = len1 + len2;
+		return new (NodeArena::current()) array_node<Elem>(a, len1 + len2);
+	}
+};
+
+#endif
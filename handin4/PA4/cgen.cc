@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <map>
 #include <stack>
+#include <sstream>
 
 //**************************************************************
 //
@@ -36,10 +37,6 @@ extern int cgen_debug;
 CgenClassTable* codegen_classtable = nullptr;
 int labelnum = 0;
 
-int Environment::AddObstacle() {
-    EnterScope();
-    return AddVar(No_class);
-}
 
 //
 // Three symbols from the semantic analyzer (semant.cc) are used.
@@ -142,14 +139,81 @@ BoolConst truebool(TRUE);
 //
 //*********************************************************
 
+// Without a collector, Int and Bool attributes, let and case variables,
+// params and temporaries hold raw words instead of objects, and a value
+// is boxed only where it escapes: into an Object, a method's result or
+// the runtime; what escapes often stays boxed throughout.  The collectors
+// scan the stack and the objects for pointers, so with one of them every
+// slot still holds an object.
+static bool unboxed_values() {
+    return cgen_Memmgr == GC_NOGC;
+}
+
+static bool unboxed_type(Symbol type) {
+    return unboxed_values() && (type == Int || type == Bool);
+}
+
+// The value slot of a String stays a pointer to its length, for the
+// runtime.
+static bool unboxed_attrib(attr_class* attrib) {
+    return unboxed_type(attrib->type_decl) && attrib->name != val
+        && !codegen_classtable->boxed_attrib(attrib);
+}
+
+// Ints, Bools and Strings are never void.
+static bool never_void(Expression e) {
+    return e->type == Int || e->type == Bool || e->type == Str;
+}
+
+// Int = Int and Bool = Bool compare raw values.
+static bool raw_equality(Expression e1, Expression e2) {
+    return unboxed_type(e1->type) && e2->type == e1->type;
+}
+
+const char* register_name(int idx) {
+    static const char* const names[SAVED_REGISTERS + TEMP_REGISTERS] = {
+        "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$t4", "$t5"
+    };
+    return names[idx];
+}
+
+Location Environment::LookUp(Symbol sym) const {
+    Location loc = LookUpVar(sym);
+    if (loc.kind != Location::None) {
+        return loc;
+    }
+    if ((loc.idx = LookUpParam(sym)) != -1) {
+        loc.kind = Location::Param;
+        loc.unboxed = IsUnboxedParam(sym);
+    } else if ((loc.idx = LookUpAttrib(sym)) != -1) {
+        loc.kind = Location::Attrib;
+        loc.unboxed = unboxed_attrib(_class_node->get_full_attributes()[loc.idx]);
+    } else if (sym == self) {
+        loc.kind = Location::Self;
+    } else {
+        loc.kind = Location::None;
+    }
+    return loc;
+}
+
 void program_class::cgen(ostream &os) 
+{
+  cgen(os, FlatTree(this));
+}
+
+// The single-process compiler lowers the tree itself once semant is done.
+void program_class::cgen(ostream &os, const FlatTree& flat)
 {
   // spim wants comments to start with '#'
   os << "# start of generated code\n";
 
   initialize_constants();
-  codegen_classtable = new CgenClassTable(classes,os);
+  labelnum = 0;
+  // The table and its nodes are freed once the code is out.
+  CgenClassTable classtable(classes,flat,os);
+  codegen_classtable = &classtable;
   codegen_classtable->Generate();
+  codegen_classtable = nullptr;
   os << "\n# end of generated code\n";
 }
 
@@ -329,12 +393,101 @@ static void emit_branch(int l, ostream& s)
 //
 // Push a register on the stack. The stack grows towards smaller addresses.
 //
-static void emit_push(char *reg, ostream& str)
+static void emit_push(const char *reg, ostream& str)
 {
   emit_store(reg,0,SP,str);
   emit_addiu(SP,SP,-4,str);
 }
 
+//
+// Put a register in the new location of a variable or temporary: another
+// register, or a push for a stack slot.  emit_unbind pops the slot again,
+// and emit_fetch_unbound then loads what was in it.
+//
+static void emit_bind(const char *source_reg, const Location& loc, ostream& s)
+{
+  if (loc.kind == Location::Register)
+    emit_move(register_name(loc.idx), source_reg, s);
+  else
+    emit_push(source_reg, s);
+}
+
+static void emit_unbind(const Location& loc, ostream& s)
+{
+  if (loc.kind == Location::Stack)
+    emit_addiu(SP,SP,4,s);
+}
+
+static void emit_fetch_unbound(const char *dest_reg, const Location& loc, ostream& s)
+{
+  if (loc.kind == Location::Register)
+    emit_move(dest_reg, register_name(loc.idx), s);
+  else
+    emit_load(dest_reg, 0, SP, s);
+}
+
+//
+// Load or store the word in the location of a variable, param or
+// attribute, with no write barrier: for unboxed ones, which only exist
+// without a collector.
+//
+static void emit_load_local(const char *dest_reg, const Location& loc, ostream& s)
+{
+  if (loc.kind == Location::Register)
+    emit_move(dest_reg, register_name(loc.idx), s);
+  else if (loc.kind == Location::Stack)
+    emit_load(dest_reg, loc.idx + 1, SP, s);
+  else if (loc.kind == Location::Param)
+    emit_load(dest_reg, loc.idx + 3, FP, s);
+  else
+    emit_load(dest_reg, loc.idx + 3, SELF, s);
+}
+
+static void emit_store_local(const char *source_reg, const Location& loc, ostream& s)
+{
+  if (loc.kind == Location::Register)
+    emit_move(register_name(loc.idx), source_reg, s);
+  else if (loc.kind == Location::Stack)
+    emit_store(source_reg, loc.idx + 1, SP, s);
+  else if (loc.kind == Location::Param)
+    emit_store(source_reg, loc.idx + 3, FP, s);
+  else
+    emit_store(source_reg, loc.idx + 3, SELF, s);
+}
+
+//
+// The frame of a method or init: the saved $s1..$s<nsaved> at the bottom,
+// then ra, self and fp.  fp points to ra, so the arguments are at fp+12
+// whatever nsaved is.
+//
+static void emit_frame_enter(int nsaved, ostream& s)
+{
+  s << "\t# push fp, s0, ra" << endl;
+  emit_addiu(SP,SP,-4 * (3 + nsaved),s);
+  emit_store(FP,3 + nsaved,SP,s);
+  emit_store(SELF,2 + nsaved,SP,s);
+  emit_store(RA,1 + nsaved,SP,s);
+  for (int i = 0; i < nsaved; i++)
+    emit_store(register_name(i),1 + i,SP,s);
+  s << endl;
+
+  s << "\t# fp now points to the return addr in stack" << endl;
+  emit_addiu(FP,SP,4 * (1 + nsaved),s);
+  s << endl;
+}
+
+static void emit_frame_leave(int nsaved, ostream& s)
+{
+  s << "\t# pop fp, s0, ra" << endl;
+  emit_load(FP,3 + nsaved,SP,s);
+  emit_load(SELF,2 + nsaved,SP,s);
+  emit_load(RA,1 + nsaved,SP,s);
+  for (int i = 0; i < nsaved; i++)
+    emit_load(register_name(i),1 + i,SP,s);
+  emit_addiu(SP,SP,4 * (3 + nsaved),s);
+  s << endl;
+}
+
 //
 // Fetch the integer value in an Int object.
 // Emits code to fetch the integer value of the Integer object pointed
@@ -350,6 +503,37 @@ static void emit_fetch_int(char *dest, char *source, ostream& s)
 static void emit_store_int(char *source, char *dest, ostream& s)
 { emit_store(source, DEFAULT_OBJFIELDS, dest, s); }
 
+//
+// Box the raw Int or Bool value in ACC.  An Int is a new object, and the
+// value is kept in a temporary over the copy; a Bool is one of the two
+// constants.
+//
+static void emit_box(Symbol type, ostream& s, Environment& env)
+{
+  if (type == Bool) {
+    emit_move(T1, ACC, s);
+    emit_load_bool(ACC, BoolConst(1), s);
+    emit_bne(T1, ZERO, labelnum, s);
+    emit_load_bool(ACC, BoolConst(0), s);
+    emit_label_def(labelnum++, s);
+    return;
+  }
+  std::string proto = Int->get_string();
+  proto += PROTOBJ_SUFFIX;
+  Location loc = env.AddTemp(true);
+  emit_bind(ACC, loc, s);
+  emit_load_address(ACC, proto.c_str(), s);
+  emit_jal("Object.copy", s);
+  emit_unbind(loc, s);
+  env.ExitScope();
+  if (loc.kind == Location::Register) {
+    emit_store(register_name(loc.idx), DEFAULT_OBJFIELDS, ACC, s);
+  } else {
+    emit_fetch_unbound(T1, loc, s);
+    emit_store_int(T1, ACC, s);
+  }
+}
+
 
 static void emit_test_collector(ostream &s)
 {
@@ -526,8 +710,7 @@ void BoolConst::code_def(ostream& s, int boolclasstag)
 
 void CgenClassTable::code_global_data()
 {
-  Symbol main    = id
-  table.lookup_string(MAINNAME);
+  Symbol main    = idtable.lookup_string(MAINNAME);
   Symbol string  = idtable.lookup_string(STRINGNAME);
   Symbol integer = idtable.lookup_string(INTNAME);
   Symbol boolc   = idtable.lookup_string(BOOLNAME);
@@ -635,38 +818,30 @@ void CgenClassTable::code_constants()
 }
 
 void method_class::code(ostream& s, CgenNode* class_node) {
+    // The body goes first, to learn how many registers the frame saves.
+    std::ostringstream body;
+    body << "\t# evaluating expression and put it to ACC" << endl;
+    Environment env(cgen_Memmgr == GC_NOGC);
+    env._class_node = class_node;
+    for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+        Formal formal = formals->nth(i);
+        env.AddParam(formal->GetName(), codegen_classtable->unboxed_param(name, i, formal->get_type()));
+    }
+    env.KeepBoxed(codegen_classtable->boxed_locals(expr));
+    expr->code(body, env);
+    body << endl;
+
     emit_method_ref(class_node->name, name, s);
     s << LABEL;
-    s << "\t# push fp, s0, ra" << endl;
-    emit_addiu(SP, SP, -12, s);
-    emit_store(FP, 3, SP, s);
-    emit_store(SELF, 2, SP, s);
-    emit_store(RA, 1, SP, s);
-    s << endl;
-    
-    s << "\t# fp now points to the return addr in stack" << endl;
-    emit_addiu(FP, SP, 4, s);
-    s << endl;
+    emit_frame_enter(env.SavedRegisters(), s);
 
     s << "\t# SELF = a0" << endl;
     emit_move(SELF, ACC, s);
     s << endl;
 
-    s << "\t# evaluating expression and put it to ACC" << endl;
-    Environment env;
-    env._class_node = class_node;
-    for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
-        env.AddParam(formals->nth(i)->GetName());
-    }
-    expr->code(s, env);
-    s << endl;
+    s << body.str();
 
-    s << "\t# pop fp, s0, ra" << endl;
-    emit_load(FP, 3, SP, s);
-    emit_load(SELF, 2, SP, s);
-    emit_load(RA, 1, SP, s);
-    emit_addiu(SP, SP, 12, s);
-    s << endl;
+    emit_frame_leave(env.SavedRegisters(), s);
 
     s << "\t# Pop arguments" << endl;
     emit_addiu(SP, SP, GetArgNum() * 4, s);
@@ -678,7 +853,7 @@ void method_class::code(ostream& s, CgenNode* class_node) {
 }
 
 void CgenNode::code_protObj(ostream& s) {
-    std::vector<attr_class*> attribs = get_full_attributes();
+    const std::vector<attr_class*>& attribs = get_full_attributes();
 
     s << WORD << "-1" << endl;
     s << get_name() << PROTOBJ_SUFFIX << LABEL;
@@ -700,7 +875,9 @@ void CgenNode::code_protObj(ostream& s) {
             s << WORD << "0\t# str(0)" << endl;
         } else { // normal attribute.
             Symbol type = attribs[i]->type_decl;
-            if (type == Int) {
+            if (unboxed_attrib(attribs[i])) {
+                s << WORD << "0\t# raw(0)" << endl;
+            } else if (type == Int) {
                 s << WORD;
                 inttable.lookup_string("0")->code_ref(s);
                 s << "\t# int(0)";
@@ -723,25 +900,12 @@ void CgenNode::code_protObj(ostream& s) {
     }
 }
 
-void CgenNode::code_init(ostream& s) {
-    s << get_name();
-    s << CLASSINIT_SUFFIX;
-    s << LABEL;
-    s << "\t# push fp, s0, ra" << endl;
-    emit_addiu(SP, SP, -12, s);
-    emit_store(FP, 3, SP, s);
-    emit_store(SELF, 2, SP, s);
-    emit_store(RA, 1, SP, s);
-    s << endl;
-    
-    s << "\t# fp now points to the return addr in stack" << endl;
-    emit_addiu(FP, SP, 4, s);
-    s << endl;
+void CgenNode::code_init(ostream& out) {
+    // The body goes first, to learn how many registers the frame saves.
+    std::ostringstream s;
+    Environment env(cgen_Memmgr == GC_NOGC);
+    env._class_node = this;
 
-    s << "\t# SELF = a0" << endl;
-    emit_move(SELF, ACC, s);
-    s << endl;
-    
     Symbol parent_name = get_parentnd()->name;
     if (parent_name != No_class) {
         s << "\t# init parent" << endl;
@@ -750,13 +914,20 @@ void CgenNode::code_init(ostream& s) {
         s << endl << endl;
     }
 
-    std::vector<attr_class*> attribs = get_attributes();
-    std::map<Symbol, int> attrib_idx_tab = get_attribute_idx_table();
+    const std::vector<attr_class*>& attribs = get_attributes();
     for (attr_class* attrib : attribs) {
         s << "\t# init attrib " << attrib->name << endl;
-        int idx = attrib_idx_tab[attrib->name];
+        int idx = GetAttribIdx(attrib->name);
 
-        if (attrib->init->IsEmpty()) {
+        if (unboxed_attrib(attrib)) {
+            // The prototype already holds a raw 0.
+            if (!attrib->init->IsEmpty()) {
+                env.KeepBoxed(codegen_classtable->boxed_locals(attrib->init));
+                attrib->init->CodeUnboxed(s, env);
+                emit_store(ACC, 3 + idx, SELF, s);
+                s << endl;
+            }
+        } else if (attrib->init->IsEmpty()) {
             // We still need to deal with basic types.
             if (attrib->type_decl == Str) {
                 emit_load_string(ACC, stringtable.lookup_string(""), s);
@@ -769,8 +940,7 @@ void CgenNode::code_init(ostream& s) {
                 emit_store(ACC, 3 + idx, SELF, s);
             }
         } else {
-            Environment env;
-            env._class_node = this;
+            env.KeepBoxed(codegen_classtable->boxed_locals(attrib->init));
             attrib->init->code(s, env);
             
             emit_store(ACC, 3 + idx, SELF, s);
@@ -786,41 +956,47 @@ void CgenNode::code_init(ostream& s) {
     emit_move(ACC, SELF, s);
     s << endl;
 
-    s << "\t# pop fp, s0, ra" << endl;
-    emit_load(FP, 3, SP, s);
-    emit_load(SELF, 2, SP, s);
-    emit_load(RA, 1, SP, s);
-    emit_addiu(SP, SP, 12, s);
-    s << endl;
+    out << get_name();
+    out << CLASSINIT_SUFFIX;
+    out << LABEL;
+    emit_frame_enter(env.SavedRegisters(), out);
 
-    s << "\t# return" << endl;
-    emit_return(s);
-    s << endl;
+    out << "\t# SELF = a0" << endl;
+    emit_move(SELF, ACC, out);
+    out << endl;
+
+    out << s.str();
+
+    emit_frame_leave(env.SavedRegisters(), out);
+
+    out << "\t# return" << endl;
+    emit_return(out);
+    out << endl;
 }
 
 void CgenNode::code_methods(ostream& s) {
-    std::vector<method_class*> methods = get_methods();
+    const std::vector<method_class*>& methods = get_methods();
     for (method_class* method : methods) {
         method->code(s, this);
     }
 }
 
 void CgenClassTable::code_protObjs() {
-    std::vector<CgenNode*> class_nodes = get_class_nodes();
+    const std::vector<CgenNode*>& class_nodes = get_class_nodes();
     for (CgenNode* class_node : class_nodes) {
         class_node->code_protObj(str);
     }
 }
 
 void CgenClassTable::code_class_inits() {
-    std::vector<CgenNode*> class_nodes = get_class_nodes();
+    const std::vector<CgenNode*>& class_nodes = get_class_nodes();
     for (CgenNode* class_node : class_nodes) {
         class_node->code_init(str);
     }
 }
 
 void CgenClassTable::code_class_methods() {
-    std::vector<CgenNode*> class_nodes = get_class_nodes();
+    const std::vector<CgenNode*>& class_nodes = get_class_nodes();
     for (CgenNode* class_node : class_nodes) {
         if (!class_node->basic()) {
             class_node->code_methods(str);
@@ -829,82 +1005,335 @@ void CgenClassTable::code_class_methods() {
 }
 
 
-std::vector<CgenNode*> CgenClassTable::get_class_nodes() {
-    if (_class_nodes.empty()) {
-        for (List<CgenNode> *l = nds; l; l = l->tl()) {
-            CgenNode* class_node = l->hd();
-            _class_nodes.push_back(class_node);
+// Give every class its tag, then lay out the classes from Object down so
+// each one can start from its parent's finished tables.
+void CgenClassTable::build_layouts() {
+    for (List<CgenNode> *l = nds; l; l = l->tl()) {
+        _class_nodes.push_back(l->hd());
+    }
+    std::reverse(_class_nodes.begin(), _class_nodes.end());
+    for (size_t i = 0; i < _class_nodes.size(); ++i) {
+        _class_nodes[i]->class_tag = (int) i;
+        _class_tags.insert(std::make_pair(_class_nodes[i]->get_name(), _class_nodes[i]->class_tag));
+    }
+
+    std::vector<CgenNode*> stack = { root() };
+    while (!stack.empty()) {
+        CgenNode* class_node = stack.back();
+        stack.pop_back();
+        class_node->build_layout();
+        for (CgenNode* child : class_node->GetChildren()) {
+            stack.push_back(child);
         }
-        std::reverse(_class_nodes.begin(), _class_nodes.end());
-        for (int i = 0; i < _class_nodes.size(); ++i) {
-            _class_nodes[i]->class_tag = i;
-            _class_tags.insert(std::make_pair(_class_nodes[i]->get_name(), i));
+    }
+}
+
+// The arrays are read in node order, with no calls through the tree.
+// The basic classes are not in the flat tree, but none of them redefines
+// a method of Object, the only class above them.
+void CgenClassTable::analyze_dispatches(const FlatTree& flat) {
+    // The class of every node: a class's nodes are those of its subtree.
+    std::vector<CgenNode*> owner(flat.size(), nullptr);
+    for (uint32_t i = 0; i < flat.size(); ++i) {
+        if (flat.kind[i] == AST_CLASS) {
+            CgenNode* class_node = get_class_node(flat.symbol(flat.fields[0][i]));
+            std::fill(owner.begin() + flat.first[i], owner.begin() + i + 1, class_node);
         }
     }
 
-    return _class_nodes;
-}
+    // A method is overridden below each proper ancestor of its class.
+    for (uint32_t i = 0; i < flat.size(); ++i) {
+        if (flat.kind[i] == AST_METHOD) {
+            const std::vector<CgenNode*>& ancestors = owner[i]->get_inheritance();
+            for (size_t j = 0; j + 1 < ancestors.size(); ++j) {
+                ancestors[j]->_overridden_below.insert(flat.symbol(flat.fields[0][i]));
+            }
+        }
+    }
 
-std::map<Symbol, int> CgenClassTable::get_class_tags() {
-    get_class_nodes();
-    return _class_tags;
+    // A dispatch calls its method directly unless a subclass of the
+    // receiver's static class overrides it.
+    _dispatch_sites = 0;
+    for (uint32_t i = 0; i < flat.size(); ++i) {
+        if (flat.kind[i] == AST_DISPATCH) {
+            ++_dispatch_sites;
+            Symbol type = flat.type[flat.fields[0][i]];
+            CgenNode* receiver = type == SELF_TYPE ? owner[i] : get_class_node(type);
+            Symbol name = flat.symbol(flat.fields[1][i]);
+            if (!receiver->IsOverriddenBelow(name)) {
+                _direct_targets[flat.node[i]] = receiver->get_dispatch_class_table().find(name)->second;
+            }
+        }
+    }
 }
 
-std::vector<CgenNode*> CgenNode::get_inheritance() {
-    if (inheritance.empty()) {
-        CgenNode* class_node = this;
-        while (class_node->name != No_class) {
-            inheritance.push_back(class_node);
-            class_node = class_node->get_parentnd();
+void CgenNode::build_layout() {
+    for (List<CgenNode>* ptr = get_children(); ptr != nullptr; ptr = ptr->tl()) {
+        _children.push_back(ptr->hd());
+    }
+
+    for (int i = features->first(); features->more(i); i = features->next(i)) {
+        Feature feature = features->nth(i);
+        if (feature->is_attr()) {
+            _attribs.push_back((attr_class*)feature);
+        } else {
+            _methods.push_back((method_class*)feature);
         }
-        std::reverse(inheritance.begin(), inheritance.end());
     }
 
-    return inheritance;
+    if (parentnd != nullptr && parentnd->name != No_class) {
+        inheritance = parentnd->inheritance;
+        _full_attribs = parentnd->_full_attribs;
+        _attrib_idx_tab = parentnd->_attrib_idx_tab;
+        _full_methods = parentnd->_full_methods;
+        _dispatch_idx_tab = parentnd->_dispatch_idx_tab;
+        _dispatch_class_tab = parentnd->_dispatch_class_tab;
+    }
+    inheritance.push_back(this);
+
+    for (attr_class* attrib : _attribs) {
+        _attrib_idx_tab[attrib->name] = _full_attribs.size();
+        _full_attribs.push_back(attrib);
+    }
+
+    // An override keeps the slot of the method it replaces.
+    for (method_class* method : _methods) {
+        Symbol method_name = method->name;
+        if (_dispatch_idx_tab.find(method_name) == _dispatch_idx_tab.end()) {
+            _full_methods.push_back(method);
+            _dispatch_idx_tab[method_name] = _full_methods.size() - 1;
+        } else {
+            _full_methods[_dispatch_idx_tab[method_name]] = method;
+        }
+        _dispatch_class_tab[method_name] = name;
+    }
 }
 
-std::vector<attr_class*> CgenNode::get_full_attributes() {
-    if ( _full_attribs.empty()) {
-        std::vector<CgenNode*> inheritance = get_inheritance();
-        for (CgenNode* class_node : inheritance) {
-            Features features = class_node->features;
-            for (int j = features->first(); features->more(j); j = features->next(j)) {
-                Feature feature = features->nth(j);
-                if (feature->is_attr()) {
-                    _full_attribs.push_back((attr_class*)feature);
+//
+// Representation analysis
+//
+// Without a collector an Int or Bool param or let/case variable can hold
+// a raw word, but a raw value is boxed again wherever a use of it is
+// evaluated for an object: passed for a boxed param, or stored in an
+// attribute or an Object.  A variable is only kept raw if none of its
+// uses are (a use as the value of the whole body is boxed at most once a
+// call, and does not count), so the analysis walks each body giving every
+// node the context the code generator will, and keeps boxed the names
+// that have a use in an object context.  A let or case variable is
+// decided by name within its body.  A param is decided by position for
+// every method of the same name, since a caller does not know which
+// override it calls, and that takes rounds to settle; the methods of the
+// basic classes take objects.
+//
+
+void CgenClassTable::analyze_representations() {
+    _boxed_params.clear();
+    _boxed_locals.clear();
+    _boxed_attribs.clear();
+    if (!unboxed_values()) {
+        return;
+    }
+
+    for (CgenNode* class_node : _class_nodes) {
+        if (class_node->basic()) {
+            for (method_class* method : class_node->get_methods()) {
+                _boxed_params[method->name].assign(method->GetArgNum(), true);
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        size_t boxed_attribs = _boxed_attribs.size();
+        for (CgenNode* class_node : _class_nodes) {
+            for (attr_class* attrib : class_node->get_attributes()) {
+                find_boxed_locals(class_node, attrib->init, unboxed_attrib(attrib),
+                                  std::unordered_set<Symbol>(), _boxed_locals[attrib->init]);
+            }
+            if (class_node->basic()) {
+                continue;
+            }
+            for (method_class* method : class_node->get_methods()) {
+                Formals formals = method->formals;
+                std::unordered_set<Symbol> params;
+                for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+                    Formal formal = formals->nth(i);
+                    if (unboxed_param(method->name, i, formal->get_type())) {
+                        params.insert(formal->GetName());
+                    }
+                }
+
+                std::unordered_set<Symbol>& boxed = _boxed_locals[method->expr];
+                find_boxed_locals(class_node, method->expr, false, params, boxed);
+
+                for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+                    Symbol param = formals->nth(i)->GetName();
+                    if (params.count(param) && boxed.count(param)) {
+                        std::vector<bool>& boxed_params = _boxed_params[method->name];
+                        boxed_params.resize(method->GetArgNum(), false);
+                        boxed_params[i] = true;
+                        changed = true;
+                    }
                 }
             }
         }
-        for (int i = 0; i < _full_attribs.size(); ++i) {
-            _attrib_idx_tab[ _full_attribs[i]->name] = i;
+        if (_boxed_attribs.size() != boxed_attribs) {
+            changed = true;
         }
     }
-
-    return _full_attribs;
 }
 
-std::vector<attr_class*> CgenNode::get_attributes() {
-    if ( _attribs.empty()) {
-        for (int j = features->first(); features->more(j); j = features->next(j)) {
-            Feature feature = features->nth(j);
-            if (feature->is_attr()) {
-                _attribs.push_back((attr_class*)feature);
+// How a value is wanted: raw, as an object, or as the object a body
+// evaluates to, which is boxed at most once per call.
+enum Want { WANT_RAW, WANT_OBJECT, WANT_RESULT };
+
+// Adds to boxed the candidates, and the Int and Bool let and case
+// variables, of which body has a use evaluated for an object, until no
+// more are found: keeping one boxed may box the uses of another.  Uses
+// that are the body's own value do not count, as boxing them once is no
+// worse than a boxed variable.  An Int or Bool attribute is kept boxed
+// by any use for an object, the method results included, as it may be
+// read any number of times per store.
+void CgenClassTable::find_boxed_locals(CgenNode* class_node, Expression body, bool raw_body,
+                                       std::unordered_set<Symbol> candidates,
+                                       std::unordered_set<Symbol>& boxed) {
+    auto attrib_of = [&](Symbol name) -> attr_class* {
+        int idx = class_node->GetAttribIdx(name);
+        return idx == -1 ? nullptr : class_node->get_full_attributes()[idx];
+    };
+    auto raw = [&](Symbol name) {
+        if (candidates.count(name) != 0) {
+            return boxed.count(name) == 0;
+        }
+        attr_class* attrib = attrib_of(name);
+        return attrib != nullptr && unboxed_attrib(attrib);
+    };
+    auto object_unless = [](bool raw_value) {
+        return raw_value ? WANT_RAW : WANT_OBJECT;
+    };
+    // A value nobody reads is wanted raw if it is an Int or Bool.
+    auto effect = [&](Expression e) {
+        return object_unless(unboxed_type(e->type));
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // Each expression, and how its value is wanted.
+        std::vector<std::pair<Expression, Want> > work;
+        work.push_back(std::make_pair(body, raw_body ? WANT_RAW : WANT_RESULT));
+        while (!work.empty()) {
+            Expression e = work.back().first;
+            Want want = work.back().second;
+            work.pop_back();
+
+            if (object_class* o = dynamic_cast<object_class*>(e)) {
+                if (want == WANT_RAW || !raw(o->name)) {
+                    continue;
+                }
+                if (candidates.count(o->name) != 0) {
+                    if (want == WANT_OBJECT) {
+                        boxed.insert(o->name);
+                        changed = true;
+                    }
+                } else {
+                    _boxed_attribs.insert(attrib_of(o->name));
+                    changed = true;
+                }
+            } else if (assign_class* a = dynamic_cast<assign_class*>(e)) {
+                work.push_back(std::make_pair(a->expr, object_unless(raw(a->name))));
+            } else if (static_dispatch_class* d = dynamic_cast<static_dispatch_class*>(e)) {
+                work.push_back(std::make_pair(d->expr, WANT_OBJECT));
+                CgenNode* callee = get_class_node(d->type_name);
+                Formals formals = callee->get_full_methods()[callee->GetDispatchIdx(d->name)]->formals;
+                for (int i = d->actual->first(); d->actual->more(i); i = d->actual->next(i)) {
+                    bool param = unboxed_param(d->name, i, formals->nth(i)->get_type());
+                    work.push_back(std::make_pair(d->actual->nth(i), object_unless(param)));
+                }
+            } else if (dispatch_class* d = dynamic_cast<dispatch_class*>(e)) {
+                work.push_back(std::make_pair(d->expr, WANT_OBJECT));
+                Symbol type = d->expr->get_type();
+                CgenNode* callee = type == SELF_TYPE ? class_node : get_class_node(type);
+                Formals formals = callee->get_full_methods()[callee->GetDispatchIdx(d->name)]->formals;
+                for (int i = d->actual->first(); d->actual->more(i); i = d->actual->next(i)) {
+                    bool param = unboxed_param(d->name, i, formals->nth(i)->get_type());
+                    work.push_back(std::make_pair(d->actual->nth(i), object_unless(param)));
+                }
+            } else if (cond_class* c = dynamic_cast<cond_class*>(e)) {
+                work.push_back(std::make_pair(c->pred, WANT_RAW));
+                work.push_back(std::make_pair(c->then_exp, want));
+                work.push_back(std::make_pair(c->else_exp, want));
+            } else if (loop_class* l = dynamic_cast<loop_class*>(e)) {
+                work.push_back(std::make_pair(l->pred, WANT_RAW));
+                work.push_back(std::make_pair(l->body, effect(l->body)));
+            } else if (typcase_class* t = dynamic_cast<typcase_class*>(e)) {
+                work.push_back(std::make_pair(t->expr, WANT_OBJECT));
+                for (branch_class* branch : t->GetCases()) {
+                    if (unboxed_type(branch->type_decl)) {
+                        candidates.insert(branch->name);
+                    }
+                    work.push_back(std::make_pair(branch->expr, want == WANT_RAW ? WANT_OBJECT : want));
+                }
+            } else if (block_class* b = dynamic_cast<block_class*>(e)) {
+                int last = b->body->len() - 1;
+                for (int i = 0; i < last; ++i) {
+                    work.push_back(std::make_pair(b->body->nth(i), effect(b->body->nth(i))));
+                }
+                work.push_back(std::make_pair(b->body->nth(last), want));
+            } else if (let_class* l = dynamic_cast<let_class*>(e)) {
+                if (unboxed_type(l->type_decl)) {
+                    candidates.insert(l->identifier);
+                }
+                work.push_back(std::make_pair(l->init, object_unless(raw(l->identifier))));
+                work.push_back(std::make_pair(l->body, want));
+            } else if (e->ArithLhs() != nullptr) {
+                work.push_back(std::make_pair(e->ArithLhs(), WANT_RAW));
+                work.push_back(std::make_pair(e->ArithRhs(), WANT_RAW));
+            } else if (neg_class* n = dynamic_cast<neg_class*>(e)) {
+                work.push_back(std::make_pair(n->e1, WANT_RAW));
+            } else if (comp_class* n = dynamic_cast<comp_class*>(e)) {
+                work.push_back(std::make_pair(n->e1, WANT_RAW));
+            } else if (lt_class* c = dynamic_cast<lt_class*>(e)) {
+                work.push_back(std::make_pair(c->e1, WANT_RAW));
+                work.push_back(std::make_pair(c->e2, WANT_RAW));
+            } else if (leq_class* c = dynamic_cast<leq_class*>(e)) {
+                work.push_back(std::make_pair(c->e1, WANT_RAW));
+                work.push_back(std::make_pair(c->e2, WANT_RAW));
+            } else if (eq_class* c = dynamic_cast<eq_class*>(e)) {
+                Want operands = object_unless(raw_equality(c->e1, c->e2));
+                work.push_back(std::make_pair(c->e1, operands));
+                work.push_back(std::make_pair(c->e2, operands));
+            } else if (isvoid_class* v = dynamic_cast<isvoid_class*>(e)) {
+                work.push_back(std::make_pair(v->e1, never_void(v->e1) ? effect(v->e1) : WANT_OBJECT));
             }
         }
     }
+}
 
-    return _attribs;
+bool CgenClassTable::unboxed_param(Symbol method, int idx, Symbol type) const {
+    if (!unboxed_type(type)) {
+        return false;
+    }
+    std::unordered_map<Symbol, std::vector<bool> >::const_iterator it = _boxed_params.find(method);
+    return it == _boxed_params.end() || idx >= (int) it->second.size() || !it->second[idx];
 }
 
-std::map<Symbol, int> CgenNode::get_attribute_idx_table() {
-    get_full_attributes();
-    return _attrib_idx_tab;
+Symbol CgenClassTable::direct_target(dispatch_class* dispatch) const {
+    std::unordered_map<tree_node*, Symbol>::const_iterator it = _direct_targets.find(dispatch);
+    return it == _direct_targets.end() ? nullptr : it->second;
+}
+
+const std::unordered_set<Symbol>& CgenClassTable::boxed_locals(Expression body) const {
+    static const std::unordered_set<Symbol> none;
+    std::unordered_map<Expression, std::unordered_set<Symbol> >::const_iterator it = _boxed_locals.find(body);
+    return it == _boxed_locals.end() ? none : it->second;
 }
 
 void CgenClassTable::code_class_nameTab() {
     str << CLASSNAMETAB << LABEL;
 
-    std::vector<CgenNode*> class_nodes = get_class_nodes();
+    const std::vector<CgenNode*>& class_nodes = get_class_nodes();
     for (CgenNode* class_node : class_nodes) {
         Symbol class_name = class_node->name;
         StringEntry* str_entry = stringtable.lookup_string(class_name->get_string());
@@ -912,7 +1341,7 @@ void CgenClassTable::code_class_nameTab() {
         str << WORD;
         str_entry->code_ref(str);
         str << endl;
-        std::vector<CgenNode*> _children = class_node->GetChildren();
+        const std::vector<CgenNode*>& _children = class_node->GetChildren();
         for (CgenNode* _child : _children) {
             str << "# child: " << _child->name << endl;
         }
@@ -923,7 +1352,7 @@ void CgenClassTable::code_class_nameTab() {
 void CgenClassTable::code_class_objTab() {
     str << CLASSOBJTAB << LABEL;
 
-    std::vector<CgenNode*> class_nodes = get_class_nodes();
+    const std::vector<CgenNode*>& class_nodes = get_class_nodes();
     for (CgenNode* class_node : class_nodes) {
         Symbol class_name = class_node->name;
         StringEntry* str_entry = stringtable.lookup_string(class_name->get_string());
@@ -938,18 +1367,17 @@ void CgenClassTable::code_class_objTab() {
 }
 
 void CgenClassTable::code_dispatchTabs() {
-    std::vector<CgenNode*> class_nodes = get_class_nodes();
+    const std::vector<CgenNode*>& class_nodes = get_class_nodes();
 
     for (CgenNode* _class_node : class_nodes) {
         emit_disptable_ref(_class_node->name, str);
         str << LABEL;
-        std::vector<method_class*> full_methods = _class_node->get_full_methods();
-        std::map<Symbol, Symbol> dispatch_class_tab = _class_node->get_dispatch_class_table();
-        std::map<Symbol, int> dispatch_idx_tab = _class_node->get_dispatch_idx_table();
+        const std::vector<method_class*>& full_methods = _class_node->get_full_methods();
+        const std::unordered_map<Symbol, Symbol>& dispatch_class_tab = _class_node->get_dispatch_class_table();
         for (method_class* _method : full_methods) {
             Symbol _method_name = _method->name;
-            Symbol _class_name = dispatch_class_tab[_method_name];
-            int _idx = dispatch_idx_tab[_method_name];
+            Symbol _class_name = dispatch_class_tab.find(_method_name)->second;
+            int _idx = _class_node->GetDispatchIdx(_method_name);
             str << "\t# method # " << _idx << endl;
             str << WORD;
             emit_method_ref(_class_name, _method_name, str);
@@ -958,53 +1386,7 @@ void CgenClassTable::code_dispatchTabs() {
     }
 }
 
-std::vector<method_class*> CgenNode::get_methods() {
-    if ( _methods.empty()) {
-        for (int i = features->first(); features->more(i); i = features->next(i)) {
-            Feature feature = features->nth(i);
-            if (!feature->is_attr()) {
-                _methods.push_back((method_class*)feature);
-            }
-        }
-    }
-    return _methods;
-}
-
-std::vector<method_class*> CgenNode::get_full_methods() {
-    if ( _full_methods.empty()) {
-
-        std::vector<CgenNode*> inheritance = get_inheritance();
-        for (CgenNode* _class_node : inheritance) {
-            Symbol _class_name = _class_node->name;
-            std::vector<method_class*> _methods = _class_node->get_methods();
-            for (method_class* _method : _methods) {
-                Symbol _method_name = _method->name;
-                if ( _dispatch_idx_tab.find(_method_name) == _dispatch_idx_tab.end()) {
-                    _full_methods.push_back(_method);
-                    _dispatch_idx_tab[_method_name] = _full_methods.size() - 1;
-                    _dispatch_class_tab[_method_name] = _class_name;
-                } else {
-                    int idx = _dispatch_idx_tab[_method_name];
-                    _full_methods[idx] = _method;
-                    _dispatch_class_tab[_method_name] = _class_name;
-                }
-            }
-        }
-    }
-    return _full_methods;
-}
-
-std::map<Symbol, Symbol> CgenNode::get_dispatch_class_table() {
-    get_full_methods();
-    return _dispatch_class_tab;
-}
-
-std::map<Symbol, int> CgenNode::get_dispatch_idx_table() {
-    get_full_methods();
-    return _dispatch_idx_tab;
-}
-
-CgenClassTable::CgenClassTable(Classes classes, ostream& s) : nds(NULL) , str(s)
+CgenClassTable::CgenClassTable(Classes classes, const FlatTree& flat, ostream& s) : nds(NULL) , str(s)
 {
 
    enterscope();
@@ -1012,11 +1394,25 @@ CgenClassTable::CgenClassTable(Classes classes, ostream& s) : nds(NULL) , str(s)
    install_basic_classes();
    install_classes(classes);
    build_inheritance_tree();
+   build_layouts();
+   analyze_dispatches(flat);
 
-   std::map<Symbol, int> class_tags = get_class_tags();
-   stringclasstag = class_tags[Str];
-   intclasstag = class_tags[Int];
-   boolclasstag = class_tags[Bool];
+   stringclasstag = get_class_tag(Str);
+   intclasstag = get_class_tag(Int);
+   boolclasstag = get_class_tag(Bool);
+}
+
+// The nodes themselves; the trees they were copied from are the arena's.
+CgenClassTable::~CgenClassTable()
+{
+  while (nds != NULL) {
+    List<CgenNode> *next = nds->tl();
+    delete nds->hd();
+    delete nds;
+    nds = next;
+  }
+  for (CgenNode* node : _special_nodes)
+    delete node;
 }
 
 void CgenClassTable::install_basic_classes()
@@ -1034,15 +1430,18 @@ void CgenClassTable::install_basic_classes()
 // SELF_TYPE is the self class; it cannot be redefined or inherited.
 // prim_slot is a class known to the code generator.
 //
-  addid(No_class,
+  _special_nodes.push_back(
     new CgenNode(class_(No_class,No_class,nil_Features(),filename),
                 Basic,this));
-  addid(SELF_TYPE,
+  addid(No_class, _special_nodes.back());
+  _special_nodes.push_back(
     new CgenNode(class_(SELF_TYPE,No_class,nil_Features(),filename),
                 Basic,this));
-  addid(prim_slot,
+  addid(SELF_TYPE, _special_nodes.back());
+  _special_nodes.push_back(
     new CgenNode(class_(prim_slot,No_class,nil_Features(),filename),
                 Basic,this));
+  addid(prim_slot, _special_nodes.back());
 
 // 
 // The Object class has no parent class. Its methods are
@@ -1228,6 +1627,10 @@ void CgenClassTable::code()
   if (cgen_debug) cout << "coding dispatch tables" << endl;
   code_dispatchTabs();
 
+  // The prototypes hold the attributes as they are stored.
+  if (cgen_debug) cout << "analyzing representations" << endl;
+  analyze_representations();
+
   if (cgen_debug) cout << "coding prototype objects" << endl;
   code_protObjs();
 
@@ -1244,6 +1647,9 @@ void CgenClassTable::code()
   if (cgen_debug) cout << "coding class methods" << endl;
   code_class_methods();
 
+  if (cgen_debug) cout << "devirtualized " << _direct_targets.size() << " of "
+                       << _dispatch_sites << " dispatch sites" << endl;
+
 }
 
 
@@ -1268,6 +1674,15 @@ CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) :
    stringtable.add_string(name->get_string());          // Add class name to string table
 }
 
+CgenNode::~CgenNode()
+{
+  while (children != NULL) {
+    List<CgenNode> *next = children->tl();
+    delete children;
+    children = next;
+  }
+}
+
 
 //******************************************************************
 //
@@ -1279,21 +1694,55 @@ CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) :
 //
 //*****************************************************************
 
-void assign_class::code(ostream& s, Environment env) {
+void Expression_class::CodeUnboxed(ostream& s, Environment& env) {
+    code(s, env);
+    s << "\t# unbox" << endl;
+    emit_fetch_int(ACC, ACC, s);
+}
+
+// An Int or Bool value nobody reads need not be boxed.
+void Expression_class::CodeEffect(ostream& s, Environment& env) {
+    if (unboxed_type(type)) {
+        CodeUnboxed(s, env);
+    } else {
+        code(s, env);
+    }
+}
+
+void Expression_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    CodeUnboxed(s, env);
+    if (when) {
+        emit_bne(ACC, ZERO, label, s);
+    } else {
+        emit_beq(ACC, ZERO, label, s);
+    }
+}
+
+void assign_class::code(ostream& s, Environment& env) {
+    if (env.LookUp(name).unboxed) {
+        CodeUnboxed(s, env);
+        emit_box(type, s, env);
+        return;
+    }
+
     s << "\t# Assign. First eval the expr." << endl;
     expr->code(s, env);
 
     s << "\t# Now find the lvalue." << endl;
-    int idx;
+    Location loc = env.LookUp(name);
+    int idx = loc.idx;
 
-    if ((idx = env.LookUpVar(name)) != -1) {
+    if (loc.kind == Location::Register) {
+        s << "\t# It is a let variable in a register." << endl;
+        emit_move(register_name(idx), ACC, s);
+    } else if (loc.kind == Location::Stack) {
         s << "\t# It is a let variable." << endl;
         emit_store(ACC, idx + 1, SP, s);
         if (cgen_Memmgr == 1) {
             emit_addiu(A1, SP, 4 * (idx + 1), s);
             emit_jal("_GenGC_Assign", s);
         }
-    } else if ((idx = env.LookUpParam(name)) != -1){
+    } else if (loc.kind == Location::Param) {
         s << "\t# It is a param." << endl;
         emit_store(ACC, idx + 3, FP, s);
         if (cgen_Memmgr == 1) {
@@ -1301,7 +1750,7 @@ void assign_class::code(ostream& s, Environment env) {
             emit_jal("_GenGC_Assign", s);
         }
     }
-    else if ((idx = env.LookUpAttrib(name)) != -1) {
+    else if (loc.kind == Location::Attrib) {
         s << "\t# It is an attribute." << endl;
         emit_store(ACC, idx + 3, SELF, s);
         if (cgen_Memmgr == 1) {
@@ -1314,21 +1763,71 @@ void assign_class::code(ostream& s, Environment env) {
     }
 }
 
-void static_dispatch_class::code(ostream& s, Environment env) {
-    s << "\t# Static dispatch. First eval and save the params." << endl;
+void assign_class::CodeUnboxed(ostream& s, Environment& env) {
+    Location loc = env.LookUp(name);
+    if (!loc.unboxed) {
+        Expression_class::CodeUnboxed(s, env);
+        return;
+    }
+
+    s << "\t# Assign a raw value." << endl;
+    expr->CodeUnboxed(s, env);
+    emit_store_local(ACC, loc, s);
+}
 
-    std::vector<Expression> actuals = GetActuals();
-    Environment new_env = env;
-    for (Expression expr : actuals) {
-        expr->code(s, env);
+// Push the arguments of a call to method of class_node; the callee pops
+// them.  Each is a scope of its own, for the caller to leave.
+static void code_actuals(CgenNode* class_node, Symbol method, const std::vector<Expression>& actuals,
+                         ostream& s, Environment& env) {
+    method_class* callee = class_node->get_full_methods()[class_node->GetDispatchIdx(method)];
+    Formals formals = callee->formals;
+    for (size_t i = 0; i < actuals.size(); ++i) {
+        if (codegen_classtable->unboxed_param(method, i, formals->nth(i)->get_type())) {
+            actuals[i]->CodeUnboxed(s, env);
+        } else {
+            actuals[i]->code(s, env);
+        }
         emit_push(ACC, s);
-        env.EnterScope();
         env.AddObstacle();
     }
+}
 
-    s << "\t# eval the obj in dispatch." << endl;
+// A dispatch nests to the left through its receiver (a.f().g() ...), so
+// the chain is walked down pushing each call's arguments, and the calls
+// are made on the way back up, innermost first.
+static void code_dispatch(Expression expr, ostream& s, Environment& env) {
+    std::vector<Expression> chain;
+    for (; expr->DispatchReceiver() != nullptr; expr = expr->DispatchReceiver()) {
+        expr->CodeArguments(s, env);
+        chain.push_back(expr);
+    }
     expr->code(s, env);
 
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        chain[i]->CodeCall(s, env);
+    }
+}
+
+void static_dispatch_class::code(ostream& s, Environment& env) {
+    code_dispatch(this, s, env);
+}
+
+void static_dispatch_class::CodeArguments(ostream& s, Environment& env) {
+    s << "\t# Static dispatch. First eval and save the params." << endl;
+
+    CgenNode* _class_node = codegen_classtable->get_class_node(type_name);
+    code_actuals(_class_node, name, GetActuals(), s, env);
+
+    s << "\t# eval the obj in dispatch." << endl;
+}
+
+void static_dispatch_class::CodeCall(ostream& s, Environment& env) {
+    CgenNode* _class_node = codegen_classtable->get_class_node(type_name);
+    // The callee pops the arguments.
+    for (int i = 0; i < actual->len(); ++i) {
+        env.ExitScope();
+    }
+
     s << "\t# if obj = void: abort" << endl;
     emit_bne(ACC, ZERO, labelnum, s);
     s << LA << ACC << " str_const0" << endl;
@@ -1338,40 +1837,39 @@ void static_dispatch_class::code(ostream& s, Environment env) {
     emit_label_def(labelnum, s);
     ++labelnum;
 
-    Symbol _class_name = type_name;
-    CgenNode* _class_node = codegen_classtable->get_class_node(type_name);
-    s << "\t# Now we locate the method in the dispatch table." << endl;
-    s << "\t# t1 = " << type_name << ".dispTab" << endl;
+    s << "\t# The method is known: call it directly" << endl;
+    s << JAL;
+    emit_method_ref(_class_node->get_dispatch_class_table().find(name)->second, name, s);
+    s << endl << endl;
 
-    std::string addr = type_name->get_string();
-    addr += DISPTAB_SUFFIX;
-    emit_load_address(T1, addr.c_str(), s);
-
-    s << endl;
-
-    int idx = _class_node->get_dispatch_idx_table()[name];
-    s << "\t# t1 = dispTab[offset]" << endl;
-    emit_load(T1, idx, T1, s);
-    s << endl;
+}
 
-    s << "\t# jumpto " << name << endl;
-    emit_jalr(T1, s);
-    s << endl;
+void dispatch_class::code(ostream& s, Environment& env) {
+    code_dispatch(this, s, env);
+}
 
+// The class whose method a dispatch calls: that of its receiver.
+static Symbol receiver_class(dispatch_class* dispatch, Environment& env) {
+    Symbol type = dispatch->expr->get_type();
+    return type == SELF_TYPE ? env._class_node->name : type;
 }
 
-void dispatch_class::code(ostream& s, Environment env) {
+void dispatch_class::CodeArguments(ostream& s, Environment& env) {
     s << "\t# Dispatch. First eval and save the params." << endl;
-    std::vector<Expression> actuals = GetActuals();
 
-    for (Expression expr : actuals) {
-        expr->code(s, env);
-        emit_push(ACC, s);
-        env.AddObstacle();
-    }
+    CgenNode* _class_node = codegen_classtable->get_class_node(receiver_class(this, env));
+    code_actuals(_class_node, name, GetActuals(), s, env);
 
     s << "\t# eval the obj in dispatch." << endl;
-    expr->code(s, env);
+}
+
+void dispatch_class::CodeCall(ostream& s, Environment& env) {
+    Symbol _class_name = receiver_class(this, env);
+    CgenNode* _class_node = codegen_classtable->get_class_node(_class_name);
+    // The callee pops the arguments.
+    for (int i = 0; i < actual->len(); ++i) {
+        env.ExitScope();
+    }
 
     s << "\t# if obj = void: abort" << endl;
     emit_bne(ACC, ZERO, labelnum, s);
@@ -1382,19 +1880,21 @@ void dispatch_class::code(ostream& s, Environment env) {
     emit_label_def(labelnum, s);
     ++labelnum;
 
-    // Get current class name;
-    Symbol _class_name = env._class_node->name;
-    if (expr->get_type() != SELF_TYPE) {
-        _class_name = expr->get_type();
+    Symbol target = codegen_classtable->direct_target(this);
+    if (target != nullptr) {
+        s << "\t# No subclass of " << _class_name << " overrides " << name << ": call it directly" << endl;
+        s << JAL;
+        emit_method_ref(target, name, s);
+        s << endl << endl;
+        return;
     }
 
-    CgenNode* _class_node = codegen_classtable->get_class_node(_class_name);
     s << "\t# Now we locate the method in the dispatch table." << endl;
     s << "\t# t1 = self.dispTab" << endl;
     emit_load(T1, 2, ACC, s);
     s << endl;
 
-    int idx = _class_node->get_dispatch_idx_table()[name];
+    int idx = _class_node->GetDispatchIdx(name);
     s << "\t# t1 = dispTab[offset]" << endl;
     emit_load(T1, idx, T1, s);
     s << endl;
@@ -1405,23 +1905,21 @@ void dispatch_class::code(ostream& s, Environment env) {
 
 }
 
-void cond_class::code(ostream& s, Environment env) {
-    s << "\t# If statement. First eval condition." << endl;
-    pred->code(s, env);
-
-    s << "\t# extract the bool content from acc to t1" << endl;
-    emit_fetch_int(T1, ACC, s);
-    s << endl;
-
+// The branches give their value as an object, or raw if unboxed.
+static void code_cond(cond_class* cond, bool unboxed, ostream& s, Environment& env) {
     int labelnum_false = labelnum++;
     int labelnum_finish = labelnum++;
     // labelnum : false.
     // labelnum + 1: finish
-    s << "\t# if t1 == 0 goto false" << endl;
-    emit_beq(T1, ZERO, labelnum_false, s);
+    s << "\t# If statement. If the condition is false goto false" << endl;
+    cond->pred->CodeBranch(s, env, false, labelnum_false);
     s << endl;
 
-    then_exp->code(s, env);
+    if (unboxed) {
+        cond->then_exp->CodeUnboxed(s, env);
+    } else {
+        cond->then_exp->code(s, env);
+    }
 
     s << "\t# jumpt finish" << endl;
     emit_branch(labelnum_finish, s);
@@ -1430,49 +1928,61 @@ void cond_class::code(ostream& s, Environment env) {
     s << "# False:" << endl;
     emit_label_def(labelnum_false, s);
 
-    else_exp->code(s, env);
+    if (unboxed) {
+        cond->else_exp->CodeUnboxed(s, env);
+    } else {
+        cond->else_exp->code(s, env);
+    }
 
     s << "# Finish:" << endl;
     emit_label_def(labelnum_finish, s);
 
 }
 
-void loop_class::code(ostream& s, Environment env) {
+void cond_class::code(ostream& s, Environment& env) {
+    code_cond(this, false, s, env);
+}
+
+void cond_class::CodeUnboxed(ostream& s, Environment& env) {
+    code_cond(this, true, s, env);
+}
+
+void cond_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    int on_false = labelnum++;
+    int finish = labelnum++;
+    s << "\t# If statement as a condition" << endl;
+    pred->CodeBranch(s, env, false, on_false);
+    then_exp->CodeBranch(s, env, when, label);
+    emit_branch(finish, s);
+    emit_label_def(on_false, s);
+    else_exp->CodeBranch(s, env, when, label);
+    emit_label_def(finish, s);
+}
+
+void loop_class::code(ostream& s, Environment& env) {
     int start = labelnum;
-    int finish = labelnum + 1;
+    int test = labelnum + 1;
     labelnum += 2;
 
-    s << "\t# While loop" << endl;
+    s << "\t# While loop, tested at the bottom" << endl;
+    emit_branch(test, s);
     s << "\t# start:" << endl;
     emit_label_def(start, s);
 
-    s << "\t# ACC = pred" << endl;
-    pred->code(s, env);
+    body->CodeEffect(s, env);
 
-    s << "\t# extract int inside bool" << endl;
-    emit_fetch_int(T1, ACC, s);
+    s << "\t# test: if pred jumpto start" << endl;
+    emit_label_def(test, s);
+    pred->CodeBranch(s, env, true, start);
     s << endl;
-
-    s << "\t# if pred == false jumpto finish" << endl;
-    emit_beq(T1, ZERO, finish, s);
-    s << endl;
-
-    body->code(s, env);
-
-    s << "\t# Jumpto start" << endl;
-    emit_branch(start, s);
-
-    s << "\t# Finish:" << endl;
-    emit_label_def(finish, s);
     
     s << "\t# ACC = void" << endl;
     emit_move(ACC, ZERO, s);
 
 }
 
-void typcase_class::code(ostream& s, Environment env) {
-    std::map<Symbol, int> _class_tags = codegen_classtable->get_class_tags();
-    std::vector<CgenNode*> _class_nodes = codegen_classtable->get_class_nodes();
+void typcase_class::code(ostream& s, Environment& env) {
+    const std::vector<CgenNode*>& _class_nodes = codegen_classtable->get_class_nodes();
     
     s << "\t# case expr" << endl;
     s << "\t# First eval e0" << endl;
@@ -1500,9 +2010,8 @@ void typcase_class::code(ostream& s, Environment env) {
         std::vector<int> __children_tags; // for return.
         for (int __curr_tag : __curr_tags) { // find children of this class.
             CgenNode* __curr_node = _class_nodes[__curr_tag];
-            std::vector<CgenNode*> __children_nodes = __curr_node->GetChildren();
-            for (CgenNode* __children_node : __children_nodes) {
-                int __children_tag = _class_tags[__children_node->name];
+            for (CgenNode* __children_node : __curr_node->GetChildren()) {
+                int __children_tag = __children_node->class_tag;
                 if (std::find(__children_tags.begin(), __children_tags.end(), __children_tag) == __children_tags.end()) {
                     __children_tags.push_back(__children_tag);
                 }
@@ -1524,7 +2033,8 @@ void typcase_class::code(ostream& s, Environment env) {
     std::vector<std::vector<int> > cases_tags;
     for (branch_class* _case : _cases) {
         Symbol _type_decl = _case->type_decl;
-        int _class_tag = _class_tags[_type_decl];
+        int _class_tag = codegen_classtable->get_class_tag(_type_decl);
+        assert(_class_tag >= 0);
         std::vector<int> case_tags = { _class_tag };
         cases_tags.push_back(case_tags);
     }
@@ -1560,10 +2070,14 @@ void typcase_class::code(ostream& s, Environment env) {
         s << "# eval expr " << caseidx << endl;
         emit_label_def(labelbeg + caseidx, s);
         env.EnterScope();
-        env.AddVar(_name);
-        emit_push(ACC, s);
+        Location loc = env.AddVar(_name, unboxed_type(_type_decl) && !env.KeepsBoxed(_name));
+        if (loc.unboxed) {
+            emit_fetch_int(ACC, ACC, s);
+        }
+        emit_bind(ACC, loc, s);
         _expr->code(s, env);
-        emit_addiu(SP, SP, 4, s);
+        emit_unbind(loc, s);
+        env.ExitScope();
 
         s << "\t# Jumpto finish" << endl;
         emit_branch(finish, s);
@@ -1575,18 +2089,45 @@ void typcase_class::code(ostream& s, Environment env) {
     s << endl;
 }
 
-void block_class::code(ostream& s, Environment env) {
-    for (int i = body->first(); body->more(i); i = body->next(i)) {
-        body->nth(i)->code(s, env);
+void block_class::code(ostream& s, Environment& env) {
+    int last = body->len() - 1;
+    for (int i = 0; i < last; ++i) {
+        body->nth(i)->CodeEffect(s, env);
     }
+    body->nth(last)->code(s, env);
 }
 
-void let_class::code(ostream& s, Environment env) {
+void block_class::CodeUnboxed(ostream& s, Environment& env) {
+    int last = body->len() - 1;
+    for (int i = 0; i < last; ++i) {
+        body->nth(i)->CodeEffect(s, env);
+    }
+    body->nth(last)->CodeUnboxed(s, env);
+}
+
+void block_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    int last = body->len() - 1;
+    for (int i = 0; i < last; ++i) {
+        body->nth(i)->CodeEffect(s, env);
+    }
+    body->nth(last)->CodeBranch(s, env, when, label);
+}
+
+void let_class::CodeInit(ostream& s, Environment& env) {
     s << "\t# Let expr" << endl;
     s << "\t# First eval init" << endl;
-    init->code(s, env);
+    bool unboxed = unboxed_type(type_decl) && !env.KeepsBoxed(identifier);
+    if (unboxed) {
+        if (init->IsEmpty()) {
+            emit_load_imm(ACC, 0, s);
+        } else {
+            init->CodeUnboxed(s, env);
+        }
+    } else {
+        init->code(s, env);
+    }
 
-    if (init->IsEmpty()) {
+    if (init->IsEmpty() && !unboxed) {
         // We still need to deal with basic types.
         if (type_decl == Str) {
             emit_load_string(ACC, stringtable.lookup_string(""), s);
@@ -1597,144 +2138,184 @@ void let_class::code(ostream& s, Environment env) {
         }
     }
 
-    s << "\t# push" << endl;
-    emit_push(ACC, s);
+    env.EnterScope();
+    s << "\t# bind" << endl;
+    emit_bind(ACC, env.AddVar(identifier, unboxed), s);
     s << endl;
+}
 
-    env.EnterScope();
-    env.AddVar(identifier);
+// A chain of lets (let a in let b in ...) is emitted in one loop, so deep
+// chains neither recurse nor copy the environment once per binding.  The
+// body gives its value as an object, or raw if unboxed.
+static void code_let(let_class* let, bool unboxed, ostream& s, Environment& env) {
+    std::vector<let_class*> lets;
+    for (;;) {
+        let->CodeInit(s, env);
+        lets.push_back(let);
+        if (let->body->AsLet() == nullptr) {
+            break;
+        }
+        let = let->body->AsLet();
+    }
 
-    body->code(s, env);
+    if (unboxed) {
+        let->body->CodeUnboxed(s, env);
+    } else {
+        let->body->code(s, env);
+    }
 
-    s << "\t# pop" << endl;
-    emit_addiu(SP, SP, 4, s);
-    s << endl;
+    for (int i = lets.size() - 1; i >= 0; --i) {
+        s << "\t# unbind" << endl;
+        emit_unbind(env.LookUpVar(lets[i]->identifier), s);
+        s << endl;
+        env.ExitScope();
+    }
 }
 
-void plus_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Add" << endl;
-    s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+void let_class::code(ostream& s, Environment& env) {
+    code_let(this, false, s, env);
+}
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
-    e2->code(s, env);
-    emit_jal("Object.copy", s);
-    s << endl;
+void let_class::CodeUnboxed(ostream& s, Environment& env) {
+    code_let(this, true, s, env);
+}
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
-    emit_move(T2, ACC, s);
-    s << endl;
+// Int operations nest to the left (a + b + c ...), so the chain is walked
+// down through e1 first and the right operands are emitted on the way back.
+// Unboxed, the whole chain works on raw words and only its result is
+// boxed.
+static void code_arith(Expression expr, ostream& s, Environment& env) {
+    if (unboxed_values()) {
+        expr->CodeUnboxed(s, env);
+        s << "\t# box the result" << endl;
+        emit_box(Int, s, env);
+        s << endl;
+        return;
+    }
 
-    s << "\t# Extract the int inside the object." << endl;
-    emit_load(T1, 3, T1, s);
-    emit_load(T2, 3, T2, s);
-    s << endl;
+    std::vector<Expression> chain;
+    for (; expr->ArithLhs() != nullptr; expr = expr->ArithLhs()) {
+        s << "\t# Int operation : " << expr->ArithName() << endl;
+        s << "\t# First eval e1 and push." << endl;
+        chain.push_back(expr);
+    }
+    expr->code(s, env);
 
-    s << "\t# Modify the int inside t2." << endl;
-    emit_add(T3, T1, T2, s);
-    emit_store(T3, 3, ACC, s);
-    s << endl;
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        Location loc = env.AddTemp(true);
+        emit_bind(ACC, loc, s);
+        s << endl;
 
-}
+        s << "\t# Then eval e2 and make a copy for result." << endl;
+        chain[i]->ArithRhs()->code(s, env);
+        emit_jal("Object.copy", s);
+        s << endl;
 
-void sub_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Sub" << endl;
-    s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+        s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
+        emit_unbind(loc, s);
+        env.ExitScope();
+        emit_fetch_unbound(T1, loc, s);
+        emit_move(T2, ACC, s);
+        s << endl;
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
-    e2->code(s, env);
-    emit_jal("Object.copy", s);
-    s << endl;
+        s << "\t# Extract the int inside the object." << endl;
+        emit_load(T1, 3, T1, s);
+        emit_load(T2, 3, T2, s);
+        s << endl;
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
-    emit_move(T2, ACC, s);
-    s << endl;
+        s << "\t# Modify the int inside t2." << endl;
+        chain[i]->EmitArithOp(T3, T1, T2, s);
+        emit_store(T3, 3, ACC, s);
+        s << endl;
+    }
+}
 
-    s << "\t# Extract the int inside the object." << endl;
-    emit_load(T1, 3, T1, s);
-    emit_load(T2, 3, T2, s);
-    s << endl;
+static void code_arith_unboxed(Expression expr, ostream& s, Environment& env) {
+    if (!unboxed_values()) {
+        code_arith(expr, s, env);
+        emit_fetch_int(ACC, ACC, s);
+        return;
+    }
 
-    s << "\t# Modify the int inside t2." << endl;
-    emit_sub(T3, T1, T2, s);
-    emit_store(T3, 3, ACC, s);
-    s << endl;
+    std::vector<Expression> chain;
+    for (; expr->ArithLhs() != nullptr; expr = expr->ArithLhs()) {
+        s << "\t# Raw Int operation : " << expr->ArithName() << endl;
+        chain.push_back(expr);
+    }
+    expr->CodeUnboxed(s, env);
+
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        Expression rhs = chain[i]->ArithRhs();
+        Location loc = env.AddTemp(!rhs->IsLeaf());
+        emit_bind(ACC, loc, s);
+        rhs->CodeUnboxed(s, env);
+        emit_unbind(loc, s);
+        env.ExitScope();
+        if (loc.kind == Location::Register) {
+            chain[i]->EmitArithOp(ACC, register_name(loc.idx), ACC, s);
+        } else {
+            emit_fetch_unbound(T1, loc, s);
+            chain[i]->EmitArithOp(ACC, T1, ACC, s);
+        }
+        s << endl;
+    }
+}
 
+void plus_class::code(ostream& s, Environment& env) {
+    code_arith(this, s, env);
 }
 
-void mul_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Mul" << endl;
-    s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+void plus_class::CodeUnboxed(ostream& s, Environment& env) {
+    code_arith_unboxed(this, s, env);
+}
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
-    e2->code(s, env);
-    emit_jal("Object.copy", s);
-    s << endl;
+void plus_class::EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s) {
+    emit_add(dest, src1, src2, s);
+}
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
-    emit_move(T2, ACC, s);
-    s << endl;
+void sub_class::code(ostream& s, Environment& env) {
+    code_arith(this, s, env);
+}
 
-    s << "\t# Extract the int inside the object." << endl;
-    emit_load(T1, 3, T1, s);
-    emit_load(T2, 3, T2, s);
-    s << endl;
+void sub_class::CodeUnboxed(ostream& s, Environment& env) {
+    code_arith_unboxed(this, s, env);
+}
 
-    s << "\t# Modify the int inside t2." << endl;
-    emit_mul(T3, T1, T2, s);
-    emit_store(T3, 3, ACC, s);
-    s << endl;
+void sub_class::EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s) {
+    emit_sub(dest, src1, src2, s);
 }
 
-void divide_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Div" << endl;
-    s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+void mul_class::code(ostream& s, Environment& env) {
+    code_arith(this, s, env);
+}
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
-    e2->code(s, env);
-    emit_jal("Object.copy", s);
-    s << endl;
+void mul_class::CodeUnboxed(ostream& s, Environment& env) {
+    code_arith_unboxed(this, s, env);
+}
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
-    emit_move(T2, ACC, s);
-    s << endl;
+void mul_class::EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s) {
+    emit_mul(dest, src1, src2, s);
+}
 
-    s << "\t# Extract the int inside the object." << endl;
-    emit_load(T1, 3, T1, s);
-    emit_load(T2, 3, T2, s);
-    s << endl;
+void divide_class::code(ostream& s, Environment& env) {
+    code_arith(this, s, env);
+}
 
-    s << "\t# Modify the int inside t2." << endl;
-    emit_div(T3, T1, T2, s);
-    emit_store(T3, 3, ACC, s);
-    s << endl;
+void divide_class::CodeUnboxed(ostream& s, Environment& env) {
+    code_arith_unboxed(this, s, env);
+}
 
+void divide_class::EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s) {
+    emit_div(dest, src1, src2, s);
 }
 
-void neg_class::code(ostream& s, Environment env) {
+void neg_class::code(ostream& s, Environment& env) {
+    if (unboxed_values()) {
+        CodeUnboxed(s, env);
+        emit_box(Int, s, env);
+        return;
+    }
+
     s << "\t# Neg" << endl;
     s << "\t# Eval e1 and make a copy for result" << endl;
     e1->code(s, env);
@@ -1748,57 +2329,144 @@ void neg_class::code(ostream& s, Environment env) {
 
 }
 
-void lt_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Less than" << endl;
+void neg_class::CodeUnboxed(ostream& s, Environment& env) {
+    s << "\t# Raw neg" << endl;
+    e1->CodeUnboxed(s, env);
+    emit_neg(ACC, ACC, s);
+}
+
+// Eval e1 and e2 into t1 and t2: raw values if raw, else the objects.
+// Raw operands need Int or Bool values and no collector.
+static void code_operands(Expression e1, Expression e2, bool raw, ostream& s, Environment& env) {
     s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
+    if (raw) {
+        e1->CodeUnboxed(s, env);
+    } else {
+        e1->code(s, env);
+    }
+    // A leaf may still box a raw variable, which is a call.
+    Location loc = env.AddTemp(!e2->IsLeaf() || (!raw && unboxed_type(e2->type)));
+    emit_bind(ACC, loc, s);
     s << endl;
 
     s << "\t# Then eval e2." << endl;
-    e2->code(s, env);
+    if (raw) {
+        e2->CodeUnboxed(s, env);
+    } else {
+        e2->code(s, env);
+    }
     s << endl;
 
     s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_unbind(loc, s);
+    env.ExitScope();
+    emit_fetch_unbound(T1, loc, s);
     emit_move(T2, ACC, s);
     s << endl;
+}
 
-    s << "\t# Extract the int inside the object." << endl;
-    emit_load(T1, 3, T1, s);
-    emit_load(T2, 3, T2, s);
-    s << endl;
+// ACC = the truth value val: a raw word if raw, else a Bool.
+static void emit_load_truth(int val, bool raw, ostream& s) {
+    if (raw) {
+        emit_load_imm(ACC, val, s);
+    } else {
+        emit_load_bool(ACC, BoolConst(val), s);
+    }
+}
+
+// ACC = the truth of pred, as above: for a predicate whose value is
+// stored or passed rather than branched on.
+static void code_truth(Expression pred, bool raw, ostream& s, Environment& env) {
+    int on_false = labelnum++;
+    int finish = labelnum++;
+    pred->CodeBranch(s, env, false, on_false);
+    emit_load_truth(1, raw, s);
+    emit_branch(finish, s);
+    emit_label_def(on_false, s);
+    emit_load_truth(0, raw, s);
+    emit_label_def(finish, s);
+}
+
+// Eval e1 and e2 of a comparison into t1 and t2 as raw ints.
+static void code_int_operands(Expression e1, Expression e2, ostream& s, Environment& env) {
+    code_operands(e1, e2, unboxed_values(), s, env);
+
+    if (!unboxed_values()) {
+        s << "\t# Extract the int inside the object." << endl;
+        emit_load(T1, 3, T1, s);
+        emit_load(T2, 3, T2, s);
+        s << endl;
+    }
+}
+
+// Jump to label if t1 < t2, or t1 <= t2 if or_equal, is when.
+static void emit_less_branch(bool or_equal, bool when, int label, ostream& s) {
+    if (when) {
+        if (or_equal) {
+            emit_bleq(T1, T2, label, s);
+        } else {
+            emit_blt(T1, T2, label, s);
+        }
+    } else {
+        if (or_equal) {
+            emit_blt(T2, T1, label, s);
+        } else {
+            emit_bleq(T2, T1, label, s);
+        }
+    }
+}
+
+// e1 < e2, or e1 <= e2 if or_equal, as a raw word or a Bool.
+static void code_less(Expression e1, Expression e2, bool or_equal, bool raw,
+                      ostream& s, Environment& env) {
+    code_int_operands(e1, e2, s, env);
 
     s << "\t# Pretend that t1 < t2" << endl;
-    emit_load_bool(ACC, BoolConst(1), s);
+    emit_load_truth(1, raw, s);
     s << "\t# If t1 < t2 jumpto finish" << endl;
-    emit_blt(T1, T2, labelnum, s);
+    emit_less_branch(or_equal, true, labelnum, s);
 
-    emit_load_bool(ACC, BoolConst(0), s);
+    emit_load_truth(0, raw, s);
     emit_label_def(labelnum, s);
 
     ++labelnum;
 }
 
-void eq_class::code(ostream& s, Environment env) {
-    s << "\t# equal" << endl;
-    s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+void lt_class::code(ostream& s, Environment& env) {
+    s << "\t# Int operation : Less than" << endl;
+    code_less(e1, e2, false, false, s, env);
+}
 
-    s << "\t# Then eval e2." << endl;
-    e2->code(s, env);
-    s << endl;
+void lt_class::CodeUnboxed(ostream& s, Environment& env) {
+    s << "\t# Int operation : Less than" << endl;
+    code_less(e1, e2, false, true, s, env);
+}
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
-    emit_move(T2, ACC, s);
-    s << endl;
+void lt_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    s << "\t# Int operation : Less than, as a condition" << endl;
+    code_int_operands(e1, e2, s, env);
+    emit_less_branch(false, when, label, s);
+}
+
+static void code_raw_equality(Expression e1, Expression e2, bool raw, ostream& s, Environment& env) {
+    code_operands(e1, e2, true, s, env);
+
+    s << "\t# Pretend that t1 = t2" << endl;
+    emit_load_truth(1, raw, s);
+    emit_beq(T1, T2, labelnum, s);
+    emit_load_truth(0, raw, s);
+    emit_label_def(labelnum, s);
+    ++labelnum;
+}
+
+void eq_class::code(ostream& s, Environment& env) {
+    s << "\t# equal" << endl;
+    if (raw_equality(e1, e2)) {
+        code_raw_equality(e1, e2, false, s, env);
+        return;
+    }
+
+    code_operands(e1, e2, false, s, env);
 
     if (e1->type == Int || e1->type == Str || e1->type == Bool)
         if (e2->type == Int || e2->type == Str || e2->type == Bool) {
@@ -1817,80 +2485,103 @@ void eq_class::code(ostream& s, Environment env) {
     ++labelnum;
 }
 
-void leq_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Less or equal" << endl;
-    s << "\t# First eval e1 and push." << endl;
-    e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
-
-    s << "\t# Then eval e2." << endl;
-    e2->code(s, env);
-    s << endl;
-
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
-    emit_move(T2, ACC, s);
-    s << endl;
+void eq_class::CodeUnboxed(ostream& s, Environment& env) {
+    if (raw_equality(e1, e2)) {
+        s << "\t# equal" << endl;
+        code_raw_equality(e1, e2, true, s, env);
+        return;
+    }
+    Expression_class::CodeUnboxed(s, env);
+}
+
+void eq_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    s << "\t# equal, as a condition" << endl;
+    bool raw = raw_equality(e1, e2);
+    code_operands(e1, e2, raw, s, env);
+
+    if (!raw && (e1->type == Int || e1->type == Str || e1->type == Bool)
+             && (e2->type == Int || e2->type == Str || e2->type == Bool)) {
+        s << "\t# equality_test gives back a0 if equal, else a1" << endl;
+        emit_load_imm(ACC, 1, s);
+        emit_load_imm(A1, 0, s);
+        emit_jal("equality_test", s);
+        if (when) {
+            emit_bne(ACC, ZERO, label, s);
+        } else {
+            emit_beq(ACC, ZERO, label, s);
+        }
+        return;
+    }
 
-    s << "\t# Extract the int inside the object." << endl;
-    emit_load(T1, 3, T1, s);
-    emit_load(T2, 3, T2, s);
-    s << endl;
+    if (when) {
+        emit_beq(T1, T2, label, s);
+    } else {
+        emit_bne(T1, T2, label, s);
+    }
+}
 
-    s << "\t# Pretend that t1 < t2" << endl;
-    emit_load_bool(ACC, BoolConst(1), s);
-    s << "\t# If t1 < t2 jumpto finish" << endl;
-    emit_bleq(T1, T2, labelnum, s);
+void leq_class::code(ostream& s, Environment& env) {
+    s << "\t# Int operation : Less or equal" << endl;
+    code_less(e1, e2, true, false, s, env);
+}
 
-    emit_load_bool(ACC, BoolConst(0), s);
-    emit_label_def(labelnum, s);
+void leq_class::CodeUnboxed(ostream& s, Environment& env) {
+    s << "\t# Int operation : Less or equal" << endl;
+    code_less(e1, e2, true, true, s, env);
+}
 
-    ++labelnum;
+void leq_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    s << "\t# Int operation : Less or equal, as a condition" << endl;
+    code_int_operands(e1, e2, s, env);
+    emit_less_branch(true, when, label, s);
 }
 
-void comp_class::code(ostream& s, Environment env) {
+void comp_class::code(ostream& s, Environment& env) {
     s << "\t# the 'not' operator" << endl;
-    s << "\t# First eval the bool" << endl;
-    e1->code(s, env);
-
-    s << "\t# Extract the int inside the bool" << endl;
-    emit_load(T1, 3, ACC, s);
-
-    s << "\t# Pretend ACC = false, then we need to construct true" << endl;
-    emit_load_bool(ACC, BoolConst(1), s);
-
-    s << "\t# If ACC = false, jumpto finish" << endl;
-    emit_beq(T1, ZERO, labelnum, s);
-
-    s << "\t# Load false" << endl;
-    emit_load_bool(ACC, BoolConst(0), s);
-
-    s << "\t# finish:" << endl;
-    emit_label_def(labelnum, s);
+    code_truth(this, false, s, env);
+}
 
-    ++labelnum;
+void comp_class::CodeUnboxed(ostream& s, Environment& env) {
+    s << "\t# the 'not' operator, raw: 1 - e1" << endl;
+    e1->CodeUnboxed(s, env);
+    emit_load_imm(T1, 1, s);
+    emit_sub(ACC, T1, ACC, s);
+}
 
+void comp_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    e1->CodeBranch(s, env, !when, label);
 }
 
-void int_const_class::code(ostream& s, Environment env) {
+void int_const_class::code(ostream& s, Environment& env) {
     //
     // Need to be sure we have an IntEntry *, not an arbitrary Symbol
     //
     emit_load_int(ACC, inttable.lookup_string(token->get_string()), s);
 }
 
-void string_const_class::code(ostream& s, Environment env) {
+void int_const_class::CodeUnboxed(ostream& s, Environment& env) {
+    emit_load_imm(ACC, atoi(token->get_string()), s);
+}
+
+void string_const_class::code(ostream& s, Environment& env) {
     emit_load_string(ACC, stringtable.lookup_string(token->get_string()), s);
 }
 
-void bool_const_class::code(ostream& s, Environment env) {
+void bool_const_class::code(ostream& s, Environment& env) {
     emit_load_bool(ACC, BoolConst(val), s);
 }
 
-void new__class::code(ostream& s, Environment env) {
+void bool_const_class::CodeUnboxed(ostream& s, Environment& env) {
+    emit_load_imm(ACC, val, s);
+}
+
+void bool_const_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    if ((val != 0) == when) {
+        emit_branch(label, s);
+    }
+}
+
+void new__class::code(ostream& s, Environment& env) {
     if (type_name == SELF_TYPE) {
         emit_load_address(T1, "class_objTab", s);
 
@@ -1905,7 +2596,8 @@ void new__class::code(ostream& s, Environment env) {
         emit_addu(T1, T1, T2, s);
 
         s << "\t# Push." << endl;
-        emit_push(T1, s);
+        Location loc = env.AddTemp(true);
+        emit_bind(T1, loc, s);
         s << endl;
 
         s << "\t# Load protObj to ACC." << endl;
@@ -1915,8 +2607,9 @@ void new__class::code(ostream& s, Environment env) {
         emit_jal("Object.copy", s);
 
         s << "\t# Pop protObj addr." << endl;
-        emit_load(T1, 1, SP, s);
-        emit_addiu(SP, SP, 4, s);
+        emit_unbind(loc, s);
+        env.ExitScope();
+        emit_fetch_unbound(T1, loc, s);
         s << endl;
 
         s << "\t# Get init addr." << endl;
@@ -1939,7 +2632,13 @@ void new__class::code(ostream& s, Environment env) {
     emit_jal(dest.c_str(), s);
 }
 
-void isvoid_class::code(ostream& s, Environment env) {
+void isvoid_class::code(ostream& s, Environment& env) {
+    if (never_void(e1)) {
+        e1->CodeEffect(s, env);
+        emit_load_bool(ACC, BoolConst(0), s);
+        return;
+    }
+
     e1->code(s, env);
 
     s << "\t# t1 = acc" << endl;
@@ -1961,36 +2660,65 @@ void isvoid_class::code(ostream& s, Environment env) {
     ++labelnum;
 }
 
-void no_expr_class::code(ostream& s, Environment env) {
+void isvoid_class::CodeBranch(ostream& s, Environment& env, bool when, int label) {
+    if (never_void(e1)) {
+        e1->CodeEffect(s, env);
+        if (!when) {
+            emit_branch(label, s);
+        }
+        return;
+    }
+
+    e1->code(s, env);
+    if (when) {
+        emit_beq(ACC, ZERO, label, s);
+    } else {
+        emit_bne(ACC, ZERO, label, s);
+    }
+}
+
+void no_expr_class::code(ostream& s, Environment& env) {
     emit_move(ACC, ZERO, s);
 }
 
-void object_class::code(ostream& s, Environment env) {
+void object_class::code(ostream& s, Environment& env) {
     s << "\t# Object:" << endl;
-    int idx;
+    Location loc = env.LookUp(name);
+    int idx = loc.idx;
 
-    if ((idx = env.LookUpVar(name)) != -1) {
+    if (loc.unboxed) {
+        s << "\t# It holds a raw value: box it." << endl;
+        emit_load_local(ACC, loc, s);
+        emit_box(type, s, env);
+        s << endl;
+        return;
+    }
+
+    if (loc.kind == Location::Register) {
+        s << "\t# It is a let variable in a register." << endl;
+        emit_move(ACC, register_name(idx), s);
+    } else if (loc.kind == Location::Stack) {
         s << "\t# It is a let variable." << endl;
         emit_load(ACC, idx + 1, SP, s);
         if (cgen_Memmgr == 1) {
             emit_addiu(A1, SP, 4 * (idx + 1), s);
             emit_jal("_GenGC_Assign", s);
         }
-    } else if ((idx = env.LookUpParam(name)) != -1) {
+    } else if (loc.kind == Location::Param) {
         s << "\t# It is a param." << endl;
         emit_load(ACC, idx + 3, FP, s);
         if (cgen_Memmgr == 1) {
             emit_addiu(A1, FP, 4 * (idx + 3), s);
             emit_jal("_GenGC_Assign", s);
         }
-    } else if ((idx = env.LookUpAttrib(name)) != -1) {
+    } else if (loc.kind == Location::Attrib) {
         s << "\t# It is an attribute." << endl;
         emit_load(ACC, idx + 3, SELF, s);
         if (cgen_Memmgr == 1) {
             emit_addiu(A1, SELF, 4 * (idx + 3), s);
             emit_jal("_GenGC_Assign", s);
         }
-    } else if (name == self) {
+    } else if (loc.kind == Location::Self) {
         s << "\t# It is self." << endl;
         emit_move(ACC, SELF, s);
     } else {
@@ -1999,3 +2727,12 @@ void object_class::code(ostream& s, Environment env) {
 
     s << endl;
 }
+
+void object_class::CodeUnboxed(ostream& s, Environment& env) {
+    Location loc = env.LookUp(name);
+    if (!loc.unboxed) {
+        Expression_class::CodeUnboxed(s, env);
+        return;
+    }
+    emit_load_local(ACC, loc, s);
+}
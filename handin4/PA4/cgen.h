@@ -3,8 +3,12 @@
 #include <stack>
 #include <vector>
 #include <list>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include "emit.h"
 #include "cool-tree.h"
+#include "tree-flat.h"
 #include "symtab.h"
 
 enum Basicness     {Basic, NotBasic};
@@ -27,7 +31,9 @@ private:
    int intclasstag;
    int boolclasstag;
    std::vector<CgenNode*> _class_nodes;
-   std::map<Symbol, int> _class_tags;
+   // No_class, SELF_TYPE and prim_slot: in the symbol table only
+   std::vector<CgenNode*> _special_nodes;
+   std::unordered_map<Symbol, int> _class_tags;
 
 // The following methods emit code for
 // constants and global declarations.
@@ -55,8 +61,28 @@ private:
    void install_classes(Classes cs);
    void build_inheritance_tree();
    void set_relations(CgenNodeP nd);
+   void build_layouts();
+
+// Representation analysis: which Int and Bool attributes, params and
+// let/case variables are kept as raw words (see cgen.cc).
+
+   std::unordered_map<Symbol, std::vector<bool> > _boxed_params;
+   std::unordered_map<Expression, std::unordered_set<Symbol> > _boxed_locals;
+   std::unordered_set<attr_class*> _boxed_attribs;
+
+// Class hierarchy analysis, a pass over the flat tree: the dispatches
+// that call the same method whatever the receiver's dynamic class, and
+// the class of that method.
+   std::unordered_map<tree_node*, Symbol> _direct_targets;
+   int _dispatch_sites;
+   void analyze_dispatches(const FlatTree& flat);
+   void analyze_representations();
+   void find_boxed_locals(CgenNode* class_node, Expression body, bool raw_body,
+                          std::unordered_set<Symbol> candidates,
+                          std::unordered_set<Symbol>& boxed);
 public:
-   CgenClassTable(Classes, ostream& str);
+   CgenClassTable(Classes, const FlatTree& flat, ostream& str);
+   ~CgenClassTable();
    void Generate() {
         code();
         exitscope();
@@ -64,13 +90,36 @@ public:
    void code();
    CgenNodeP root();
 
-   std::vector<CgenNode*> get_class_nodes();
+   // Classes indexed by class tag; fixed once the constructor returns.
+   const std::vector<CgenNode*>& get_class_nodes() const { return _class_nodes; }
 
-   std::map<Symbol, int> get_class_tags();
-   CgenNode* get_class_node(Symbol class_name) {
-        get_class_nodes();
-        return _class_nodes[_class_tags[class_name]];
+   // -1 for a name that is not a class.
+   int get_class_tag(Symbol class_name) const {
+        std::unordered_map<Symbol, int>::const_iterator it = _class_tags.find(class_name);
+        return it == _class_tags.end() ? -1 : it->second;
    }
+   // Only for names that are classes, as semant has checked every class
+   // name in the tree to be.
+   CgenNode* get_class_node(Symbol class_name) const {
+        int tag = get_class_tag(class_name);
+        assert(tag >= 0);
+        return _class_nodes[tag];
+   }
+
+   // Whether param idx, of the given type, of the methods called method
+   // is passed as a raw word.
+   bool unboxed_param(Symbol method, int idx, Symbol type) const;
+
+   // The let and case variables of a method or attribute init that hold
+   // objects even when they are Ints or Bools.
+   const std::unordered_set<Symbol>& boxed_locals(Expression body) const;
+
+   // Whether an Int or Bool attribute holds an object.
+   bool boxed_attrib(attr_class* attrib) const { return _boxed_attribs.count(attrib) != 0; }
+
+   // The class whose method dispatch runs on every receiver, or NULL if
+   // that depends on the receiver's dynamic class.
+   Symbol direct_target(dispatch_class* dispatch) const;
 };
 
 
@@ -85,6 +134,7 @@ public:
    CgenNode(Class_ c,
             Basicness bstatus,
             CgenClassTableP class_table);
+   ~CgenNode();
 
    void add_child(CgenNodeP child);
    List<CgenNode> *get_children() { return children; }
@@ -92,43 +142,54 @@ public:
    CgenNodeP get_parentnd() { return parentnd; }
    int basic() { return (basic_status == Basic); }
 
-   std::vector<CgenNode*> GetChildren() {
-        std::vector<CgenNode*> ret;
-        List<CgenNode>* ptr = get_children();
-        while (ptr != nullptr) {
-            ret.push_back(ptr->hd());
-            ptr = ptr->tl();
-        }
-        return ret;
-    }
+    const std::vector<CgenNode*>& GetChildren() const { return _children; }
 
     void code_protObj(ostream& s);
     void code_init(ostream& s);
     void code_methods(ostream& s);
 
-    std::vector<method_class*> get_methods();
+    // Layout tables, filled in once by build_layout() (after the parent's)
+    // and only read afterwards.
+    void build_layout();
+
+    const std::vector<method_class*>& get_methods() const { return _methods; }
     std::vector<method_class*> _methods;
 
-    std::vector<method_class*> get_full_methods();
+    const std::vector<method_class*>& get_full_methods() const { return _full_methods; }
     std::vector<method_class*> _full_methods;
 
-    std::map<Symbol, Symbol> get_dispatch_class_table();
-    std::map<Symbol, Symbol> _dispatch_class_tab;
+    const std::unordered_map<Symbol, Symbol>& get_dispatch_class_table() const { return _dispatch_class_tab; }
+    std::unordered_map<Symbol, Symbol> _dispatch_class_tab;
 
-    std::map<Symbol, int> get_dispatch_idx_table();
-    std::map<Symbol, int> _dispatch_idx_tab;
+    const std::unordered_map<Symbol, int>& get_dispatch_idx_table() const { return _dispatch_idx_tab; }
+    std::unordered_map<Symbol, int> _dispatch_idx_tab;
+    int GetDispatchIdx(Symbol method) const {
+        std::unordered_map<Symbol, int>::const_iterator it = _dispatch_idx_tab.find(method);
+        return it == _dispatch_idx_tab.end() ? -1 : it->second;
+    }
 
-    std::vector<attr_class*> get_attributes();
+    const std::vector<attr_class*>& get_attributes() const { return _attribs; }
     std::vector<attr_class*> _attribs;
 
-    std::vector<attr_class*> get_full_attributes();
+    const std::vector<attr_class*>& get_full_attributes() const { return _full_attribs; }
     std::vector<attr_class*> _full_attribs;
 
-    std::map<Symbol, int> get_attribute_idx_table();
-    std::map<Symbol, int> _attrib_idx_tab;
+    const std::unordered_map<Symbol, int>& get_attribute_idx_table() const { return _attrib_idx_tab; }
+    std::unordered_map<Symbol, int> _attrib_idx_tab;
+    int GetAttribIdx(Symbol attrib) const {
+        std::unordered_map<Symbol, int>::const_iterator it = _attrib_idx_tab.find(attrib);
+        return it == _attrib_idx_tab.end() ? -1 : it->second;
+    }
 
-    std::vector<CgenNode*> get_inheritance();
+    const std::vector<CgenNode*>& get_inheritance() const { return inheritance; }
     std::vector<CgenNode*> inheritance;
+    std::vector<CgenNode*> _children;
+
+    // The methods some proper subclass defines, filled in by
+    // analyze_dispatches().  A method outside it has the same code in
+    // every object of this class or a subclass.
+    bool IsOverriddenBelow(Symbol method) const { return _overridden_below.count(method) != 0; }
+    std::unordered_set<Symbol> _overridden_below;
 
     int class_tag;
 };
@@ -143,63 +204,178 @@ class BoolConst
   void code_ref(ostream&) const;
 };
 
+// Where an identifier lives while a method body is being generated.
+// Stack slots are counted from the top of the stack (0 = last push),
+// params from the frame pointer and attributes from self; a register is
+// an index into the Environment's registers (see register_name()).  An
+// unboxed variable or param holds the raw value of an Int or Bool instead
+// of the object.
+struct Location {
+    enum Kind { None, Stack, Param, Attrib, Self, Register };
+    Kind kind;
+    int idx;
+    bool unboxed;
+};
+
+// The registers variables and temporaries are kept in: the callee-saved
+// $s1-$s6 (a method saves the ones it uses; the runtime keeps its heap
+// limit in $s7), then caller-saved ones for temporaries that are not
+// live across a call.
+enum { SAVED_REGISTERS = 6, TEMP_REGISTERS = 2 };
+const char* register_name(int idx);
+
+// One Environment is shared by reference through a whole method body.
+// A let/case variable or a temporary ("obstacle") gets a register while
+// there is one free and a stack slot after that; names map straight to
+// their innermost location, and scopes are left by unwinding a log back
+// to a mark instead of copying the tables.  Scopes nest, so registers
+// are handed out and given back in stack order, and a variable of an
+// outer scope keeps its register through the inner ones.
 class Environment {
 public:
-    std::vector<int> _scope_lengths;
-    std::vector<Symbol> _var_idx_tab;
-    std::vector<Symbol> _param_idx_tab;
     CgenNode* _class_node;
 
-    Environment() : _class_node(nullptr) {}
+    // Without registers, every variable and temporary is pushed: the
+    // garbage collectors only find the pointers on the stack.
+    explicit Environment(bool use_registers)
+        : _class_node(nullptr), _use_registers(use_registers), _stack_depth(0),
+          _next_saved(0), _next_temp(0), _saved_used(0) {}
 
     void EnterScope() {
-        _scope_lengths.push_back(0);
+        _scope_marks.push_back(_slot_log.size());
     }
 
     void ExitScope() {
-        for (int i = 0; i < _scope_lengths[_scope_lengths.size() - 1]; ++i) {
-            _var_idx_tab.pop_back();
-        }
-        _scope_lengths.pop_back();
-    }
-
-    int LookUpAttrib(Symbol sym) {
-        std::map<Symbol, int> attrib_idx_tab = _class_node->get_attribute_idx_table();
-        if (attrib_idx_tab.find(sym) != attrib_idx_tab.end()) {
-            return attrib_idx_tab[sym];
+        size_t mark = _scope_marks.back();
+        _scope_marks.pop_back();
+        while (_slot_log.size() > mark) {
+            const Slot& slot = _slot_log.back();
+            if (slot.sym != nullptr) {
+                _var_slots[slot.sym].pop_back();
+            }
+            if (slot.loc.kind == Location::Stack) {
+                --_stack_depth;
+            } else if (slot.loc.idx < SAVED_REGISTERS) {
+                --_next_saved;
+            } else {
+                --_next_temp;
+            }
+            _slot_log.pop_back();
         }
-        return -1;
     }
 
     // The vars are in reverse order.
-    int LookUpVar(Symbol sym) {
-        for (int idx = _var_idx_tab.size() - 1; idx >= 0; --idx) {
-            if (_var_idx_tab[idx] == sym) {
-                return _var_idx_tab.size() - 1 - idx;
+    Location LookUpVar(Symbol sym) const {
+        Location loc = { Location::None, -1, false };
+        std::unordered_map<Symbol, std::vector<Location> >::const_iterator it = _var_slots.find(sym);
+        if (it != _var_slots.end() && !it->second.empty()) {
+            loc = it->second.back();
+            if (loc.kind == Location::Stack) {
+                loc.idx = _stack_depth - 1 - loc.idx;
             }
         }
-        return -1;
+        return loc;
     }
 
-    int AddVar(Symbol sym) {
-        _var_idx_tab.push_back(sym);
-        ++_scope_lengths[_scope_lengths.size() - 1];
-        return _var_idx_tab.size() - 1;
+    // A variable in the current scope.  A Stack one is a new slot the
+    // caller pushes.
+    Location AddVar(Symbol sym, bool unboxed) {
+        Location loc = Allocate(true);
+        loc.unboxed = unboxed;
+        _var_slots[sym].push_back(loc);
+        _slot_log.push_back(Slot(sym, loc));
+        return loc;
     }
 
-    int AddObstacle();
+    // A temporary, in a scope of its own.  One that is not live across a
+    // call may get a caller-saved register.
+    Location AddTemp(bool across_call) {
+        EnterScope();
+        Location loc = Allocate(across_call);
+        _slot_log.push_back(Slot(nullptr, loc));
+        return loc;
+    }
 
-    int LookUpParam(Symbol sym) {
-        for (int idx = 0; idx < _param_idx_tab.size(); ++idx) {
-            if (_param_idx_tab[idx] == sym) {
-                return _param_idx_tab.size() - 1 - idx;
-            }
+    // A pushed temporary, in a scope of its own: the arguments of a
+    // dispatch, which the callee finds on the stack.
+    int AddObstacle() {
+        EnterScope();
+        Location loc = { Location::Stack, _stack_depth++, false };
+        _slot_log.push_back(Slot(nullptr, loc));
+        return loc.idx;
+    }
+
+    // How many of $s1-$s6 the code so far has used.
+    int SavedRegisters() const { return _saved_used; }
+
+    int LookUpParam(Symbol sym) const {
+        std::unordered_map<Symbol, int>::const_iterator it = _param_idx_tab.find(sym);
+        if (it == _param_idx_tab.end()) {
+            return -1;
         }
-        return -1;
+        return _param_idx_tab.size() - 1 - it->second;
     }
 
-    int AddParam(Symbol sym) {
-        _param_idx_tab.push_back(sym);
+    int AddParam(Symbol sym, bool unboxed) {
+        _param_idx_tab.insert(std::make_pair(sym, (int)_param_idx_tab.size()));
+        if (unboxed) {
+            _unboxed_params.insert(sym);
+        }
         return _param_idx_tab.size() - 1;
     }
+
+    bool IsUnboxedParam(Symbol sym) const {
+        return _unboxed_params.count(sym) != 0;
+    }
+
+    // Int and Bool let and case variables with these names hold objects.
+    void KeepBoxed(const std::unordered_set<Symbol>& names) {
+        _boxed_locals.insert(names.begin(), names.end());
+    }
+
+    bool KeepsBoxed(Symbol sym) const {
+        return _boxed_locals.count(sym) != 0;
+    }
+
+    int LookUpAttrib(Symbol sym) const {
+        return _class_node->GetAttribIdx(sym);
+    }
+
+    // Variables shadow params, which shadow attributes.
+    Location LookUp(Symbol sym) const;
+
+private:
+    struct Slot {
+        Symbol sym;
+        Location loc;
+        Slot(Symbol s, Location l) : sym(s), loc(l) {}
+    };
+
+    Location Allocate(bool across_call) {
+        Location loc = { Location::Register, -1, false };
+        if (_use_registers && !across_call && _next_temp < TEMP_REGISTERS) {
+            loc.idx = SAVED_REGISTERS + _next_temp++;
+        } else if (_use_registers && _next_saved < SAVED_REGISTERS) {
+            loc.idx = _next_saved++;
+            if (_next_saved > _saved_used) {
+                _saved_used = _next_saved;
+            }
+        } else {
+            loc.kind = Location::Stack;
+            loc.idx = _stack_depth++;
+        }
+        return loc;
+    }
+
+    bool _use_registers;
+    int _stack_depth;
+    int _next_saved;
+    int _next_temp;
+    int _saved_used;
+    std::unordered_map<Symbol, std::vector<Location> > _var_slots;
+    std::vector<Slot> _slot_log;
+    std::vector<size_t> _scope_marks;
+    std::unordered_map<Symbol, int> _param_idx_tab;
+    std::unordered_set<Symbol> _unboxed_params;
+    std::unordered_set<Symbol> _boxed_locals;
 };
\ No newline at end of file
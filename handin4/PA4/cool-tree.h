@@ -79,12 +79,35 @@ public:
 
 // define simple phylum - Expression
 typedef class Expression_class *Expression;
+class let_class;
 
 class Expression_class : public tree_node {
 public:
    tree_node *copy()     { return copy_Expression(); }
    virtual Expression copy_Expression() = 0;
    virtual bool IsEmpty() { return false; }
+   // A leaf only loads its value into ACC: it uses no other register
+   // and, without a collector, calls nothing.
+   virtual bool IsLeaf() { return false; }
+   // Leaves the value of an Int or Bool expression in ACC as a raw word
+   // instead of an object; CodeEffect evaluates one only for its effect.
+   virtual void CodeUnboxed(ostream& s, Environment& env);
+   void CodeEffect(ostream& s, Environment& env);
+   // Evaluates a Bool expression and jumps to label if it is when, with
+   // no Bool object made; otherwise falls through.  ACC is left undefined.
+   virtual void CodeBranch(ostream& s, Environment& env, bool when, int label);
+   // Used to walk let chains, left-nested Int operations and dispatch
+   // chains (a.f().g() ...) without recursion.
+   virtual let_class* AsLet() { return nullptr; }
+   virtual Expression ArithLhs() { return nullptr; }
+   virtual Expression ArithRhs() { return nullptr; }
+   virtual const char* ArithName() { return nullptr; }
+   virtual void EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s) {}
+   virtual Expression DispatchReceiver() { return nullptr; }
+   // Of a dispatch: pushes the arguments, before the receiver; then,
+   // with the receiver in ACC, calls the method.
+   virtual void CodeArguments(ostream& s, Environment& env) {}
+   virtual void CodeCall(ostream& s, Environment& env) {}
 #ifdef Expression_EXTRAS
    Expression_EXTRAS
 #endif
@@ -179,6 +202,7 @@ public:
 
 
 // define constructor - method
+typedef class method_class* Method;
 class method_class : public Feature_class {
 public:
    Symbol name;
@@ -213,6 +237,7 @@ public:
 
 
 // define constructor - attr
+typedef class attr_class* Attr;
 class attr_class : public Feature_class {
 public:
    Symbol name;
@@ -296,6 +321,7 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -329,6 +355,9 @@ public:
       }
       return ret;
    }
+   Expression DispatchReceiver() { return expr; }
+   void CodeArguments(ostream& s, Environment& env);
+   void CodeCall(ostream& s, Environment& env);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -360,6 +389,9 @@ public:
       }
       return ret;
    }
+   Expression DispatchReceiver() { return expr; }
+   void CodeArguments(ostream& s, Environment& env);
+   void CodeCall(ostream& s, Environment& env);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -384,6 +416,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -455,6 +489,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -481,6 +517,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   let_class* AsLet() { return this; }
+   void CodeInit(ostream& s, Environment& env);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -503,6 +542,11 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   Expression ArithLhs() { return e1; }
+   Expression ArithRhs() { return e2; }
+   const char* ArithName() { return "Add"; }
+   void EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -525,6 +569,11 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   Expression ArithLhs() { return e1; }
+   Expression ArithRhs() { return e2; }
+   const char* ArithName() { return "Sub"; }
+   void EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -547,6 +596,11 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   Expression ArithLhs() { return e1; }
+   Expression ArithRhs() { return e2; }
+   const char* ArithName() { return "Mul"; }
+   void EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -569,6 +623,11 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   Expression ArithLhs() { return e1; }
+   Expression ArithRhs() { return e2; }
+   const char* ArithName() { return "Div"; }
+   void EmitArithOp(const char* dest, const char* src1, const char* src2, ostream& s);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -589,6 +648,7 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -611,6 +671,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -633,6 +695,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -655,6 +719,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -675,6 +741,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -695,6 +763,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   bool IsLeaf() { return true; }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -715,6 +785,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
+   bool IsLeaf() { return true; }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -735,6 +808,7 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool IsLeaf() { return true; }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -775,6 +849,7 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeBranch(ostream& s, Environment& env, bool when, int label);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -794,6 +869,7 @@ public:
    Expression copy_Expression();
    void dump(ostream& stream, int n);
    bool IsEmpty() { return true; }
+   bool IsLeaf() { return true; }
    
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -814,6 +890,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   void CodeUnboxed(ostream& s, Environment& env);
+   bool IsLeaf() { return true; }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -5,6 +5,8 @@
 #define COOL_TREE_HANDCODE_H
 
 #include <iostream>
+#include <stdint.h>
+#include <vector>
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
@@ -34,6 +36,9 @@ class Expression_class;
 typedef Expression_class *Expression;
 class Case_class;
 typedef Case_class *Case;
+class let_class;
+class AstWriter;
+class FlatTree;
 
 typedef list_node<Class_> Classes_class;
 typedef Classes_class *Classes;
@@ -46,66 +51,273 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
+// The semantic checks (check_type, is_defined, ...) are
+// those of ../../handin3; they are declared here as well so that the
+// single-process compiler (coolc.cc) can run semant and cgen on the
+// same tree.
+
 #define Program_EXTRAS                          \
+virtual void semant() = 0;			\
+virtual int check_semantics() = 0;		\
 virtual void cgen(ostream&) = 0;		\
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void cgen(ostream&, const FlatTree&) = 0; \
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 
 #define program_EXTRAS                          \
+void semant();     				\
+int check_semantics();				\
 void cgen(ostream&);     			\
-void dump_with_types(ostream&, int);            
+void cgen(ostream&, const FlatTree&);		\
+void dump_with_types(ostream&, int); \
+uint32_t write_binary(AstWriter&);
 
 #define Class__EXTRAS                   \
 virtual Symbol get_name() = 0;  	\
 virtual Symbol get_parent() = 0;    	\
 virtual Symbol get_filename() = 0;      \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual Features get_features() = 0;    \
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void check_type() = 0;          \
+virtual void is_defined() = 0; \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define class__EXTRAS                                  \
 Symbol get_name()   { return name; }		       \
 Symbol get_parent() { return parent; }     	       \
 Symbol get_filename() { return filename; }             \
-void dump_with_types(ostream&,int);                    
+Features get_features() { return features; }           \
+void dump_with_types(ostream&,int);                    \
+void check_type();                                     \
+void is_defined(); \
+uint32_t write_binary(AstWriter&);
 
 
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; 		\
+virtual Symbol get_name() = 0;                  		\
+virtual Symbol get_type() = 0;                  		\
+virtual void is_defined() = 0;                  		\
+virtual Symbol check_type() = 0;                		\
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int);    				\
+uint32_t write_binary(AstWriter&);
+
+#define method_EXTRAS                  \
+Symbol get_name() { return name; }                  \
+Symbol get_return_type() { return return_type; }    \
+Formals get_formals() { return formals; }           \
+Expression get_expr() { return expr; }              \
+Symbol get_type() { return return_type; }           \
+void is_defined();                                  \
+Symbol check_type();                                \
+Boolean check_inherit_method();                     \
+Method get_inherit_method();
+
+
+#define attr_EXTRAS \
+Symbol get_name() { return name; }                  \
+Symbol get_type() { return type_decl; }             \
+Expression get_init() { return init; }              \
+void is_defined();                                  \
+Symbol check_type();
 
 
 #define Formal_EXTRAS                              \
-virtual void dump_with_types(ostream&,int) = 0;
+virtual void dump_with_types(ostream&,int) = 0;	\
+virtual Symbol get_name() = 0;                      \
+virtual Symbol get_type() = 0;                      \
+virtual Symbol check_type() = 0; \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define formal_EXTRAS                           \
-void dump_with_types(ostream&,int);
+void dump_with_types(ostream&,int);		\
+Symbol get_name() { return name; }              \
+Symbol get_type() { return type_decl; }         \
+Symbol check_type(); \
+uint32_t write_binary(AstWriter&);
 
 
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0;
+Symbol type;                                     \
+virtual Symbol get_type() {return type; }        \
+virtual void dump_with_types(ostream& ,int) = 0; \
+virtual Symbol get_name() = 0;                   \
+virtual Symbol check_type() = 0;                 \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int);
+void dump_with_types(ostream& ,int);			\
+Symbol get_name() { return name; }                      \
+Expression get_expr() { return expr; }                  \
+Symbol get_type_decl() { return type_decl; }            \
+Symbol check_type(); \
+uint32_t write_binary(AstWriter&);
 
 
 #define Expression_EXTRAS                    \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
-virtual void code(ostream&, Environment) = 0; \
+virtual void code(ostream&, Environment&) = 0; \
 virtual void dump_with_types(ostream&,int) = 0;  \
 void dump_type(ostream&, int);               \
-Expression_class() { type = (Symbol) NULL; }
+Expression_class() { type = (Symbol) NULL; } \
+virtual Symbol check_type() = 0;             \
+virtual let_class* as_let() { return NULL; } \
+/* the left operand of + - * / or the receiver of a dispatch, for \
+walking chains that nest to the left without recursion */ \
+virtual Expression chain_e1() { return NULL; } \
+virtual Symbol check_chained(Symbol type1) { return NULL; } \
+virtual uint32_t write_chained(AstWriter&, uint32_t e1) { return 0; } \
+virtual uint32_t write_binary(AstWriter&) = 0;
 
 #define Expression_SHARED_EXTRAS           \
-void code(ostream&, Environment); 			   \
-void dump_with_types(ostream&,int); 
+void code(ostream&, Environment&); 			   \
+void dump_with_types(ostream&,int); 			   \
+uint32_t write_binary(AstWriter&);
+
+#define assign_EXTRAS \
+Symbol get_name() { return name; }                       \
+Expression get_expr() { return expr; }                   \
+Symbol check_type();
+
+#define static_dispatch_EXTRAS \
+Expression get_expr() { return expr; }                   \
+Expression chain_e1() { return expr; }                   \
+Symbol check_chained(Symbol type1);                      \
+uint32_t write_chained(AstWriter&, uint32_t e1);         \
+Symbol get_type_name() { return type_name; } 					\
+Symbol get_name() { return name; } 					\
+Expressions get_actual() { return actual; } 					\
+Symbol check_type();
+
+#define dispatch_EXTRAS \
+Expression get_expr() { return expr; }                   \
+Expression chain_e1() { return expr; }                   \
+Symbol check_chained(Symbol type1);                      \
+uint32_t write_chained(AstWriter&, uint32_t e1);         \
+Symbol get_name() { return name; } 					\
+Expressions get_actual() { return actual; } 					\
+Symbol check_type();
+
+#define cond_EXTRAS \
+Expression get_pred() { return pred; }                   \
+Expression get_then_exp() { return then_exp; }                   \
+Expression get_else_exp() { return else_exp; }                   \
+Symbol check_type();
+
+#define loop_EXTRAS \
+Expression get_pred() { return pred; }                   \
+Expression get_body() { return body; }                   \
+Symbol check_type();
+
+#define block_EXTRAS \
+Expressions get_body() { return body; }                   \
+Symbol check_type();
+
+#define let_EXTRAS \
+Symbol get_identifier() { return identifier; } 					\
+Symbol get_type_decl() { return type_decl; } 					\
+Expression get_init() { return init; }                   \
+Expression get_body() { return body; }                   \
+let_class* as_let() { return this; }                     \
+void check_binding();                                    \
+Symbol check_type();
+
+#define typcase_EXTRAS \
+Expression get_expr() { return expr; }                   \
+Cases get_cases() {return cases; }                \
+Symbol check_type();
+
+#define new__EXTRAS \
+Symbol get_type_name() { return type_name; } \
+Symbol check_type();
+
+#define isvoid_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Symbol check_type();
+
+#define plus_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
+Symbol check_type();
+
+#define sub_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
+Symbol check_type();
+
+#define mul_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
+Symbol check_type();
+
+#define divide_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Expression chain_e1() { return e1; }                 \
+Symbol check_chained(Symbol type1);                  \
+uint32_t write_chained(AstWriter&, uint32_t e1);     \
+Symbol check_type();
+
+#define neg_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Symbol check_type();
+
+#define lt_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Symbol check_type();
+
+#define eq_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Symbol check_type();
+
+#define leq_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Expression get_e2() { return e2; }                   \
+Symbol check_type();
+
+#define comp_EXTRAS \
+Expression get_e1() { return e1; }                   \
+Symbol check_type();
+
+#define int_const_EXTRAS \
+Symbol get_token() { return token; }                   \
+Symbol check_type();
+
+#define bool_const_EXTRAS \
+Boolean get_val() { return val; }                   \
+Symbol check_type();
+
+#define string_const_EXTRAS \
+Symbol get_token() { return token; }                   \
+Symbol check_type();
+
+#define no_expr_EXTRAS \
+Symbol check_type();
+
+#define object_EXTRAS \
+Symbol check_type();
 
 
 #endif
@@ -0,0 +1,49 @@
+//
+// The main() of coolc, the single-process compiler (see coolc.cc).
+// It takes the same flags as the phases of mycoolc.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include "cool-io.h"
+#include "coolc.h"
+
+extern int optind;            // used for option processing (man 3 getopt for more info)
+extern char *out_filename;    // name of output assembly
+
+void handle_flags(int argc, char *argv[]);
+
+int main(int argc, char *argv[])
+{
+    handle_flags(argc, argv);
+    if (optind >= argc) {
+        cerr << "usage: " << argv[0] << " [flags] file.cl ... | file.ast" << endl;
+        exit(1);
+    }
+
+    if (!out_filename) {   // no -o option: name the output after the first file
+        char *dot = strrchr(argv[optind], '.');
+        size_t len = dot ? dot - argv[optind] : strlen(argv[optind]);
+        out_filename = new char[len + 3];
+        memcpy(out_filename, argv[optind], len);
+        strcpy(out_filename + len, ".s");
+    }
+
+    //
+    // Don't touch the output file until we know that the program is
+    // correct.
+    //
+    std::string assembly;
+    if (!compile_files(argc - optind, argv + optind, assembly)) {
+        exit(1);
+    }
+    ofstream s(out_filename);
+    if (!s) {
+        cerr << "Cannot open output file " << out_filename << endl;
+        exit(1);
+    }
+    s << assembly;
+    return 0;
+}
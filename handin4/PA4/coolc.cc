@@ -0,0 +1,127 @@
+//
+// coolc: the whole compiler in one process.
+//
+// mycoolc runs lexer | parser | semant | cgen, and every phase prints the
+// tokens or the tree for the next one to parse again.  Here the parser
+// (../../handin2) builds the tree from the scanner (../../handin1) directly,
+// semant (../../handin3) annotates that same tree with types, and cgen
+// walks it, so nothing is printed or re-read in between.
+//
+// COOL_PARSE_JOBS=n lexes up to n source files at once, and COOL_PARSE_FAST
+// parses them with the hand-written parser in cool.y; COOL_SEMANT_JOBS
+// and COOL_SEMANT_CACHE work as they do for semant.  COOL_PARSE_TREE=file
+// and COOL_SEMANT_TREE=file save the tree in the binary format of
+// tree-binary.h after the parser and after semant; given such a file
+// instead of sources (file.ast), coolc starts from the saved tree
+// without lexing or parsing.  semant checks a saved tree even if it is
+// typed: cgen trusts every class, method and type name in the tree, and
+// the file only promises valid indices.  The compiler's main() is in
+// coolc-phase.cc.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include "cool-tree.h"
+#include "tree-arena.h"
+#include "tree-binary.h"
+#include "tree-flat.h"
+#include "coolc.h"
+
+extern int omerrs;            // lex and parse errors
+
+extern Program cool_parse_files(int nfiles, char **files, int jobs);
+extern Program cool_parse_buffers(int n, char **names, char **texts, size_t *lens, int jobs);
+
+FILE *fin;                    // the single-file scanner's input; unused here
+char *curr_filename = (char *) "<stdin>";
+
+static int parse_jobs()
+{
+    const char* jobs = getenv("COOL_PARSE_JOBS");
+    return jobs != NULL ? atoi(jobs) : 1;
+}
+
+// Where COOL_PARSE_TREE or COOL_SEMANT_TREE asks for the tree to be
+// saved: false if it cannot be.
+static bool save_tree(const char* option, Program program, bool typed)
+{
+    const char* path = getenv(option);
+    return path == NULL || write_binary_tree(program, path, typed);
+}
+
+// The phases after the parser, on the program it has just built or a
+// saved tree: false, with the errors reported, if it has lex, parse or
+// semantic errors.
+static bool compile_program(Program program, std::string& assembly)
+{
+    if (omerrs != 0) {
+        cerr << "Compilation halted due to lex and parse errors" << endl;
+        return false;
+    }
+    if (!save_tree("COOL_PARSE_TREE", program, false)) {
+        return false;
+    }
+    int errors = program->check_semantics();
+    if (errors > 0) {
+        cerr << "Compilation halted due to static semantic errors." << endl;
+    }
+    if (errors != 0) {
+        return false;
+    }
+    if (!save_tree("COOL_SEMANT_TREE", program, true)) {
+        return false;
+    }
+
+    std::ostringstream os;
+    program->cgen(os, FlatTree(program));
+    assembly += os.str();
+    return true;
+}
+
+// Every compilation builds its tree, and the basic classes semant and
+// cgen add to it, in an arena of its own, freed when the compilation is
+// over.
+bool compile(const std::vector<CoolSource>& sources, std::string& assembly)
+{
+    int n = sources.size();
+    std::vector<char*> names(n);
+    std::vector<char*> texts(n);
+    std::vector<size_t> lens(n);
+    for (int i = 0; i < n; ++i) {
+        names[i] = (char *) sources[i].name;
+        texts[i] = (char *) sources[i].text;
+        lens[i] = sources[i].len;
+    }
+
+    NodeArena arena;
+    NodeArena* previous = NodeArena::install(&arena);
+    omerrs = 0;
+    Program program = cool_parse_buffers(n, names.data(), texts.data(), lens.data(), parse_jobs());
+    bool ok = compile_program(program, assembly);
+    NodeArena::install(previous);
+    return ok;
+}
+
+static bool is_tree_file(const char* name)
+{
+    size_t len = strlen(name);
+    return len > 4 && strcmp(name + len - 4, ".ast") == 0;
+}
+
+bool compile_files(int nfiles, char **files, std::string& assembly)
+{
+    NodeArena arena;
+    NodeArena* previous = NodeArena::install(&arena);
+    omerrs = 0;
+    Program program;
+    if (nfiles == 1 && is_tree_file(files[0])) {
+        program = read_binary_tree(files[0], NULL);
+    } else {
+        program = cool_parse_files(nfiles, files, parse_jobs());
+    }
+    bool ok = program != NULL && compile_program(program, assembly);
+    NodeArena::install(previous);
+    return ok;
+}
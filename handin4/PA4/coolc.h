@@ -0,0 +1,34 @@
+#ifndef COOLC_H
+#define COOLC_H
+//
+// The single-process compiler.
+//
+// compile() runs the lexer, parser, semantic checker and code generator
+// of the handins on a set of sources in one process: the tree built by
+// the parser is checked and annotated in place by semant and handed
+// straight to cgen, instead of being printed and re-read between the
+// phases of mycoolc.
+//
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// One source file, already in memory.  `name' is what error messages
+// and the classes' filename refer to.
+struct CoolSource {
+    const char* name;
+    const char* text;
+    size_t len;
+};
+
+// Compile the sources as one program and append its assembly to
+// `assembly'.  Errors are reported on cerr, as the phases report them;
+// if there are any, nothing is appended and false is returned.
+bool compile(const std::vector<CoolSource>& sources, std::string& assembly);
+
+// The same for files on disk, which the scanner maps instead of copying.
+// A single file.ast is a tree saved by an earlier run (see coolc.cc).
+bool compile_files(int nfiles, char **files, std::string& assembly);
+
+#endif
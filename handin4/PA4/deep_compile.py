@@ -0,0 +1,94 @@
+import os
+import sys
+import argparse
+import resource
+import subprocess
+import tempfile
+
+# Compiles programs nested very deep, with both parsers, on an 8 MB stack.
+# Chains the parsers build in a loop (let ... in let ..., a + b + ...,
+# a.f().g() ...) and long blocks must compile at any length; other
+# nesting must compile up to the parsers' limits and, past them, fail
+# with an error rather than run out of stack.
+
+parser = argparse.ArgumentParser(description = 'check that deep programs compile or fail cleanly')
+parser.add_argument('-c', '--coolc', default = './coolc')
+parser.add_argument('-n', '--length', default = 50000, type = int)
+parser.add_argument('-d', '--depth', default = 2000, type = int)
+args = parser.parse_args()
+
+n = args.length
+d = args.depth
+main = 'class Main inherits IO {{\n  me : Main <- self;\n  f() : SELF_TYPE {{ self }};\n  main() : Object {{\n{0}\n  }};\n}};\n'
+
+def lets():
+	return ''.join('let x{0} : Int <- {0} in\n'.format(i) for i in range(n)) + 'me.out_int(x0 + x{0})'.format(n - 1)
+
+def let_list():
+	return 'let ' + ',\n'.join('x{0} : Int <- {0}'.format(i) for i in range(n)) + '\nin me.out_int(x0 + x{0})'.format(n - 1)
+
+def plus():
+	return 'let x : Int <- ' + ' + '.join(['1'] * n) + ' in me.out_int(x - ' + ' - '.join(['1'] * n) + ')'
+
+def dispatch():
+	return 'me' + '.f()' * n + '.out_int(1)'
+
+def long_block():
+	return '{\n' + 'me.out_int(1);\n' * n + '}'
+
+def nested_blocks(depth):
+	return '{ ' * depth + 'me.out_int(1);' + ' };' * (depth - 1) + ' }'
+
+def nested_parens(depth):
+	return 'me.out_int(' + '1 + (' * depth + '1' + ')' * depth + ')'
+
+def nested_ifs(depth):
+	return 'if true then ' * depth + 'me.out_int(1)' + ' else me fi' * depth
+
+# name, body, whether it compiles
+cases = [
+	('let chain', lets(), True),
+	('let list', let_list(), True),
+	('+ chain', plus(), True),
+	('dispatch chain', dispatch(), True),
+	('long block', long_block(), True),
+	('nested blocks', nested_blocks(d), True),
+	('nested parentheses', nested_parens(d), True),
+	('nested ifs', nested_ifs(d), True),
+	('blocks past the limit', nested_blocks(n), False),
+	('parentheses past the limit', nested_parens(n), False),
+]
+
+def limit_stack():
+	resource.setrlimit(resource.RLIMIT_STACK, (8 << 20, 8 << 20))
+
+work = tempfile.mkdtemp()
+failed = False
+for i, (name, body, compiles) in enumerate(cases):
+	source = os.path.join(work, 'deep{0}.cl'.format(i))
+	with open(source, 'w') as out:
+		out.write(main.format(body))
+	for fast in [False, True]:
+		env = dict(os.environ,
+			COOL_SEMANT_CACHE = os.path.join(work, 'cache'),
+			COOL_PARSE_TREE = os.path.join(work, 'parse.tree'),
+			COOL_SEMANT_TREE = os.path.join(work, 'semant.tree'))
+		env.pop('COOL_PARSE_FAST', None)
+		if fast:
+			env['COOL_PARSE_FAST'] = '1'
+		if os.path.exists(env['COOL_SEMANT_CACHE']):
+			os.remove(env['COOL_SEMANT_CACHE'])
+		with open(os.devnull, 'w') as devnull:
+			status = subprocess.call([args.coolc, '-o', os.path.join(work, 'deep{0}.s'.format(i)), source],
+				env = env, stdout = devnull, stderr = devnull, preexec_fn = limit_stack)
+		parser_name = 'hand-written parser' if fast else 'bison'
+		if status < 0:
+			print('Wrong!!!!!!! {0} ({1}): killed by signal {2}'.format(name, parser_name, -status))
+			failed = True
+		elif (status == 0) != compiles:
+			print('Wrong!!!!!!! {0} ({1}): exited with {2}'.format(name, parser_name, status))
+			failed = True
+if failed:
+	print('(deep0.cl ... are in {0})'.format(work))
+	sys.exit(1)
+print('Success, {0} cases'.format(len(cases)))
@@ -0,0 +1,53 @@
+import os
+import sys
+import argparse
+import subprocess
+import tempfile
+
+# Compiles the same files several times with their lexing spread over
+# threads, and once on one thread, and checks that the assembly is the
+# same byte for byte every time: the threads must not change the order
+# of the constants.
+
+parser = argparse.ArgumentParser(description = 'check that parallel lexing gives the same output')
+parser.add_argument('-c', '--coolc', default = './coolc')
+parser.add_argument('-j', '--jobs', default = 4, type = int)
+parser.add_argument('-r', '--runs', default = 2, type = int)
+parser.add_argument('-n', '--literals', default = 3000, type = int)
+args = parser.parse_args()
+
+work = tempfile.mkdtemp()
+files = []
+for f in range(args.jobs):
+	name = os.path.join(work, 'g{0}.cl'.format(f))
+	with open(name, 'w') as out:
+		out.write('class G{0} {{\n  f() : Object {{ {{\n'.format(f))
+		for i in range(args.literals):
+			# some text of each file's own, some shared between files
+			out.write('    "s{0}_{1}"; {2}; "shared{3}"; x{3};\n'.format(f, i, i * 7 + f, i % 50))
+		out.write('  } };\n')
+		for i in range(50):
+			out.write('  x{0} : Int;\n'.format(i))
+		out.write('};\n')
+	files.append(name)
+name = os.path.join(work, 'main.cl')
+with open(name, 'w') as out:
+	out.write('class Main inherits IO {\n  me : Main <- self;\n  main() : Object { me.out_string("hi\\n") };\n};\n')
+files.append(name)
+
+def compile(jobs, run):
+	output = os.path.join(work, 'out{0}_{1}.s'.format(jobs, run))
+	env = dict(os.environ, COOL_PARSE_JOBS = str(jobs))
+	status = subprocess.call([args.coolc, '-o', output] + files, env = env)
+	if status != 0:
+		print('Fail, {0} exited with {1}'.format(args.coolc, status))
+		sys.exit(1)
+	with open(output, 'rb') as f:
+		return f.read()
+
+expected = compile(1, 0)
+for run in range(args.runs):
+	if compile(args.jobs, run) != expected:
+		print('Wrong!!!!!!! run {0} with {1} jobs differs from one job (see {2})'.format(run, args.jobs, work))
+		sys.exit(1)
+print('Success, {0} parallel runs match'.format(args.runs))
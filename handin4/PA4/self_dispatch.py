@@ -0,0 +1,77 @@
+import os
+import sys
+import argparse
+import shutil
+import subprocess
+import tempfile
+
+# Compiles programs that dispatch on self, written f() or self.f(), with
+# methods returning SELF_TYPE, and checks their output when spim is on
+# the PATH.  semant must look these methods up in the class being
+# checked.
+
+parser = argparse.ArgumentParser(description = 'check that dispatches on self compile and run')
+parser.add_argument('-c', '--coolc', default = './coolc')
+parser.add_argument('-s', '--spim', default = 'spim')
+args = parser.parse_args()
+
+hello = '''class Main inherits IO {
+  main() : Object { out_string("hi\\n") };
+};
+'''
+
+chains = '''class A inherits IO {
+  n : Int <- 1;
+  me() : SELF_TYPE { self };
+  show() : SELF_TYPE { out_int(n).out_string(" ") };
+  bump() : SELF_TYPE { { n <- n + 1; self; } };
+  twice() : SELF_TYPE { bump().bump() };
+};
+class B inherits A {
+  show() : SELF_TYPE { { out_string("B:"); out_int(n); out_string(" "); } };
+};
+class Main inherits IO {
+  main() : Object {
+    let a : A <- new A, b : A <- new B, c : SELF_TYPE <- copy() in {
+      a.twice().show();
+      b.me().twice().show();
+      self.out_string("ok\\n");
+      c.out_string(type_name().concat("\\n"));
+    }
+  };
+};
+'''
+
+# name, program, what it prints
+cases = [
+	('hello', hello, 'hi\n'),
+	('chains', chains, '3 B:3 ok\nMain\n'),
+]
+
+spim = shutil.which(args.spim)
+work = tempfile.mkdtemp()
+failed = False
+for name, program, expected in cases:
+	source = os.path.join(work, name + '.cl')
+	output = os.path.join(work, name + '.s')
+	with open(source, 'w') as out:
+		out.write(program)
+	status = subprocess.call([args.coolc, '-o', output, source])
+	if status != 0:
+		print('Wrong!!!!!!! {0}: {1} exited with {2}'.format(name, args.coolc, status))
+		failed = True
+		continue
+	if spim is None:
+		continue
+	run = subprocess.run([spim, '-file', output], stdout = subprocess.PIPE, universal_newlines = True)
+	# spim prints its banner, then the program, then the runtime's last word
+	if expected + 'COOL program successfully executed' not in run.stdout:
+		print('Wrong!!!!!!! {0} printed:\n{1}'.format(name, run.stdout))
+		failed = True
+if failed:
+	print('(the programs are in {0})'.format(work))
+	sys.exit(1)
+if spim is None:
+	print('Success, {0} programs compiled ({1} not found, not run)'.format(len(cases), args.spim))
+else:
+	print('Success, {0} programs'.format(len(cases)))
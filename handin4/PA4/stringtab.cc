@@ -0,0 +1,83 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include "stringtab.h"
+
+extern char *pad(int n);
+
+//
+// String arena
+//
+// Entry characters are copied into large blocks that are never freed
+// (entries live as long as the compiler), instead of one allocation per
+// entry.
+//
+static const int ARENA_BLOCK = 1 << 16;
+static char *arena_next = NULL;
+static int arena_left = 0;
+
+static char *arena_copy(char *s, int len)
+{
+  if (len + 1 > arena_left) {
+    int size = len + 1 > ARENA_BLOCK ? len + 1 : ARENA_BLOCK;
+    arena_next = (char *) malloc(size);
+    arena_left = size;
+  }
+  char *str = arena_next;
+  memcpy(str, s, len);
+  str[len] = '\0';
+  arena_next += len + 1;
+  arena_left -= len + 1;
+  return str;
+}
+
+//
+// Entry
+//
+Entry::Entry(char *s, int l, int i, unsigned int h) : len(l), index(i), hash(h)
+{
+  str = arena_copy(s, l);
+}
+
+int Entry::equal_string(char *string, int length) const
+{
+  return (len == length) && (memcmp(str, string, len) == 0);
+}
+
+ostream& Entry::print(ostream& s) const
+{
+  return s << "{" << str << ", " << len << ", " << index << "}\n";
+}
+
+ostream& operator<<(ostream& s, const Entry& sym)
+{
+  return s << sym.get_string();
+}
+
+ostream& operator<<(ostream& s, Symbol sym)
+{
+  return s << *sym;
+}
+
+char *Entry::get_string() const
+{
+  return str;
+}
+
+int Entry::get_len() const
+{
+  return len;
+}
+
+StringEntry::StringEntry(char *s, int l, int i, unsigned int h) : Entry(s, l, i, h) { }
+IdEntry::IdEntry(char *s, int l, int i, unsigned int h) : Entry(s, l, i, h) { }
+IntEntry::IntEntry(char *s, int l, int i, unsigned int h) : Entry(s, l, i, h) { }
+
+IdTable idtable;
+IntTable inttable;
+StrTable stringtable;
@@ -0,0 +1,313 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+// -*-Mode: C++;-*-
+//
+// The symbol tables of the compiler.
+//
+// `idtable', `inttable' and `stringtable' are instances of StringTable.
+// Entries are interned: a string is entered once, and every later
+// add_string of the same characters returns the same Entry pointer, so
+// Symbols can be compared with ==.
+//
+// This version keeps the course interface (the `tbl' list, `index',
+// first/more/next and lookup) but finds entries through an
+// open-addressing hash table instead of walking the list, so add_string
+// and lookup_string are O(1). Entry characters live in a shared arena.
+//
+
+#ifndef _STRINGTAB_H_
+#define _STRINGTAB_H_
+
+#include <assert.h>
+#include <string.h>
+#include <vector>
+#include "list.h" // list template
+#include "cool-io.h"
+
+class Entry;
+typedef Entry* Symbol;
+
+extern ostream& operator<<(ostream& s, const Entry& sym);
+extern ostream& operator<<(ostream& s, Symbol sym);
+
+// FNV-1a over the first len characters of s.
+inline unsigned int stringtab_hash(const char *s, int len)
+{
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+//
+// Entry
+//
+// An entry is a string, its length, its index in the table and the hash
+// of its characters.
+//
+class Entry {
+  template <class Elem> friend class StringTable;
+protected:
+  char *str;     // the string, stored in the string arena
+  int  len;      // the length of the string (without trailing \0)
+  int index;     // a unique index for each string
+  unsigned int hash;
+public:
+  // h is stringtab_hash(s, l), which the table has already computed
+  Entry(char *s, int l, int i, unsigned int h);
+
+  // is string argument equal to the str of this Entry?
+  int equal_string(char *s, int len) const;
+
+  // is the integer argument equal to the index of this Entry?
+  bool equal_index(int ind) const           { return ind == index; }
+
+  ostream& print(ostream& s) const;
+
+  // Return the str and len components of the Entry.
+  char *get_string() const;
+  int get_len() const;
+  unsigned int get_hash() const             { return hash; }
+};
+
+//
+// There are three kinds of string table entries:
+//   a true string, an string representation of an identifier, and
+//   a string representation of an integer.
+//
+// Having separate tables is convenient for code generation.  Different
+// data definitions are generated for string constants (StringEntry) and
+// integer  constants (IntEntry).  Identifiers (IdEntry) don't produce
+// static data definitions.
+//
+// code_def and code_ref are used by the code to produce definitions and
+// references (respectively) to constants.
+//
+class StringEntry : public Entry {
+public:
+  void code_def(ostream& str, int stringclasstag);
+  void code_ref(ostream& str);
+  StringEntry(char *s, int l, int i, unsigned int h);
+};
+
+class IdEntry : public Entry {
+public:
+  IdEntry(char *s, int l, int i, unsigned int h);
+};
+
+class IntEntry: public Entry {
+public:
+  void code_def(ostream& str, int intclasstag);
+  void code_ref(ostream& str);
+  IntEntry(char *s, int l, int i, unsigned int h);
+};
+
+typedef StringEntry *StringEntryP;
+typedef IdEntry *IdEntryP;
+typedef IntEntry *IntEntryP;
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  String Tables
+//
+//////////////////////////////////////////////////////////////////////////
+
+template <class Elem>
+class StringTable
+{
+protected:
+   List<Elem> *tbl;   // all entries, most recently added first
+   int index;         // the current index
+   std::vector<Elem*> by_index;  // entries by index
+   std::vector<Elem*> slots;     // open addressing, linear probing; size is a power of 2
+
+   // the slot holding s, or the empty slot where it belongs
+   size_t find_slot(char *s, int len, unsigned int h) const {
+     size_t mask = slots.size() - 1;
+     for (size_t i = h & mask; ; i = (i + 1) & mask) {
+       Elem *e = slots[i];
+       if (e == NULL || (e->get_hash() == h && e->equal_string(s, len)))
+         return i;
+     }
+   }
+
+   void grow() {
+     std::vector<Elem*> old;
+     old.swap(slots);
+     slots.assign(old.empty() ? 1024 : old.size() * 2, (Elem*) NULL);
+     size_t mask = slots.size() - 1;
+     for (size_t i = 0; i < old.size(); i++)
+       if (old[i] != NULL) {
+         size_t j = old[i]->get_hash() & mask;
+         while (slots[j] != NULL) j = (j + 1) & mask;
+         slots[j] = old[i];
+       }
+   }
+
+public:
+   StringTable(): tbl((List<Elem> *) NULL), index(0) { }   // an empty table
+
+   // If s is not in the table, then add it.  Either way, return the
+   // entry for s.  Only the first maxchars characters are entered.
+   Elem *add_string(char *s, int maxchars);
+   Elem *add_string(char *s);
+   Elem *add_int(int i);
+
+   // An iterator.
+   int first();       // first index
+   int more(int i);   // are there more indices?
+   int next(int i);   // next index
+
+   Elem *lookup(int index);      // lookup an element using its index
+   Elem *lookup_string(char *s); // lookup an element using its string
+   // the entry for the first len characters of s, or NULL if they have
+   // never been entered; unlike lookup_string, a miss is not an error
+   Elem *probe_string(char *s, int len);
+
+   int size() const { return index; }  // the number of entries
+
+   // Give the entries added since the table had base entries the indices
+   // base, base + 1, ... in the order they first appear in order, which
+   // holds every one of them and may hold older entries too.  Entries
+   // added by several threads at once get the indices one thread would
+   // have given them.
+   void renumber(int base, const std::vector<Symbol> &order);
+
+   void print();  // print the entire table; for debugging
+};
+
+template <class Elem>
+Elem *StringTable<Elem>::add_string(char *s, int maxchars)
+{
+  int len = 0;
+  while (len < maxchars && s[len] != '\0') len++;
+  unsigned int h = stringtab_hash(s, len);
+
+  // keep the load factor at or below 1/2
+  if (slots.size() < 2 * (size_t) (index + 1)) grow();
+  size_t i = find_slot(s, len, h);
+  if (slots[i] != NULL) return slots[i];
+
+  Elem *e = new Elem(s, len, index++, h);
+  slots[i] = e;
+  by_index.push_back(e);
+  tbl = new List<Elem>(e, tbl);
+  return e;
+}
+
+template <class Elem>
+Elem *StringTable<Elem>::add_string(char *s)
+{
+  return add_string(s, (int) strlen(s));
+}
+
+template <class Elem>
+Elem *StringTable<Elem>::add_int(int i)
+{
+  char buf[20];
+  snprintf(buf, 20, "%d", i);
+  return add_string(buf);
+}
+
+template <class Elem>
+int StringTable<Elem>::first()
+{
+  return 0;
+}
+
+template <class Elem>
+int StringTable<Elem>::more(int i)
+{
+  return i < index;
+}
+
+template <class Elem>
+int StringTable<Elem>::next(int i)
+{
+  assert(i < index);
+  return i + 1;
+}
+
+template <class Elem>
+Elem *StringTable<Elem>::lookup(int ind)
+{
+  assert(ind >= 0 && ind < index);
+  return by_index[ind];
+}
+
+template <class Elem>
+Elem *StringTable<Elem>::lookup_string(char *s)
+{
+  int len = (int) strlen(s);
+  Elem *e = slots.empty() ? NULL : slots[find_slot(s, len, stringtab_hash(s, len))];
+  assert(e != NULL);
+  return e;
+}
+
+template <class Elem>
+Elem *StringTable<Elem>::probe_string(char *s, int len)
+{
+  return slots.empty() ? NULL : slots[find_slot(s, len, stringtab_hash(s, len))];
+}
+
+template <class Elem>
+void StringTable<Elem>::renumber(int base, const std::vector<Symbol> &order)
+{
+  int next = base;
+  for (size_t i = 0; i < order.size(); i++) {
+    Elem *e = static_cast<Elem *>(order[i]);
+    // indices below next are older entries or already placed
+    if (e->index < next)
+      continue;
+    // swap e into the next index
+    Elem *other = by_index[next];
+    other->index = e->index;
+    by_index[e->index] = other;
+    e->index = next;
+    by_index[next++] = e;
+  }
+  assert(next == index);
+
+  // tbl lists the new entries first, newest first
+  List<Elem> *rest = tbl;
+  for (int i = base; i < index; i++) {
+    List<Elem> *old = rest;
+    rest = rest->tl();
+    delete old;
+  }
+  for (int i = base; i < index; i++)
+    rest = new List<Elem>(by_index[i], rest);
+  tbl = rest;
+}
+
+template <class Elem>
+void StringTable<Elem>::print()
+{
+  for (List<Elem> *l = tbl; l; l = l->tl())
+    l->hd()->print(cerr);
+}
+
+class IdTable : public StringTable<IdEntry> { };
+
+class IntTable : public StringTable<IntEntry>
+{
+ public:
+   void code_string_table(ostream&, int classtag);
+};
+
+class StrTable : public StringTable<StringEntry>
+{
+ public:
+   void code_string_table(ostream&, int classtag);
+};
+
+extern IdTable idtable;
+extern IntTable inttable;
+extern StrTable stringtable;
+#endif